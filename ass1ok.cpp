@@ -1,168 +1,5462 @@
-#include <iostream>
-
-class LinkedList {
-private:
-    struct Node {
-        int data;
-        Node* next;
-        Node(int val) : data(val), next(nullptr) {}
-    };
-    Node* head;
-
-public:
-    LinkedList() : head(nullptr) {}
-    ~LinkedList();
-    void insert(int value);
-    void remove(int value);
-    bool contains(int value) const;
-    LinkedList& operator=(const LinkedList& other);
-    friend std::ostream& operator<<(std::ostream& out, const LinkedList& list);
-};
-
-LinkedList::~LinkedList() {
-    Node* current = head;
-    while (current != nullptr) {
-        Node* next = current->next;
-        delete current;
-        current = next;
-    }
-}
-
-void LinkedList::insert(int value) {
-    if (contains(value)) return;
-    Node* newNode = new Node(value);
-    newNode->next = head;
-    head = newNode;
-}
-
-void LinkedList::remove(int value) {
-    Node* current = head;
-    Node* prev = nullptr;
-    while (current != nullptr) {
-        if (current->data == value) {
-            if (prev == nullptr) {
-                head = current->next;
-            } else {
-                prev->next = current->next;
-            }
-            delete current;
-            return;
-        }
-        prev = current;
-        current = current->next;
-    }
-}
-
-bool LinkedList::contains(int value) const {
-    Node* current = head;
-    while (current != nullptr) {
-        if (current->data == value) {
-            return true;
-        }
-        current = current->next;
-    }
-    return false;
-}
-
-LinkedList& LinkedList::operator=(const LinkedList& other) {
-    if (this != &other) {
-        Node* current = head;
-        while (current != nullptr) {
-            Node* next = current->next;
-            delete current;
-            current = next;
-        }
-        head = nullptr;
-
-        current = other.head;
-        Node* tail = nullptr;
-        while (current != nullptr) {
-            Node* newNode = new Node(current->data);
-            if (tail == nullptr) {
-                head = newNode;
-            } else {
-                tail->next = newNode;
-            }
-            tail = newNode;
-            current = current->next;
-        }
-    }
-    return *this;
-}
-
-std::ostream& operator<<(std::ostream& out, const LinkedList& list) {
-    LinkedList::Node* current = list.head;
-    while (current != nullptr) {
-        out << current->data << " ";
-        current = current->next;
-    }
-    return out;
-}
-
-class Set {
-private:
-    LinkedList elements;
-
-public:
-    Set() {}
-    Set(const int arr[], size_t size);
-    friend std::istream& operator>>(std::istream& in, Set& s);
-    friend std::ostream& operator<<(std::ostream& out, const Set& s);
-    Set operator+(const Set& other) const;
-    Set operator*(const Set& other) const;
-    Set& operator+=(int value);
-    Set& operator=(const Set& other);
-};
-
-Set::Set(const int arr[], size_t size) {
-    for (size_t i = 0; i < size; ++i) {
-        elements.insert(arr[i]);
-    }
-}
-
-std::istream& operator>>(std::istream& in, Set& s) {
-    int value;
-    while (in >> value) {
-        s.elements.insert(value);
-    }
-    return in;
-}
-
-std::ostream& operator<<(std::ostream& out, const Set& s) {
-    out << s.elements;
-    return out;
-}
-
-Set Set::operator+(const Set& other) const {
-    Set result = *this;
-    LinkedList::Node* current = other.elements.head;
-    while (current != nullptr) {
-        result.elements.insert(current->data);
-        current = current->next;
-    }
-    return result;
-}
-
-Set Set::operator*(const Set& other) const {
-    Set result;
-    LinkedList::Node* current = elements.head;
-    while (current != nullptr) {
-        if (other.elements.contains(current->data)) {
-            result.elements.insert(current->data);
-        }
-        current = current->next;
-    }
-    return result;
-}
-
-Set& Set::operator+=(int value) {
-    elements.insert(value);
-    return *this;
-}
-
-Set& Set::operator=(const Set& other) {
-    if (this != &other) {
-        elements = other.elements;
-    }
-    return *this;
-}
+#include <iostream>
+#include <iterator>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include <climits>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <charconv>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <type_traits>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Values a hash table holds inline before it allocates; see BasicHashTable.
+#ifndef SET_INLINE_CAPACITY
+#define SET_INLINE_CAPACITY 16
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SET_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Writes values each followed by a space, as out << value << " " does, but
+// formats them with to_chars into a local buffer and hands that to the
+// stream buffer in one call per block, skipping the sentry and locale
+// lookups per value. A stream set up for something else (another base,
+// showpos, a width, unitbuf or a locale other than "C") and one-byte types,
+// which the stream prints as characters, keep the formatted path so the
+// text is the same either way. Nothing reaches the stream before flush(),
+// which is left to the caller so a stream error surfaces there and not in
+// a destructor.
+class ValueWriter {
+private:
+    std::ostream& out;
+    bool direct;
+    size_t used;
+    char buffer[1 << 15];
+
+public:
+    explicit ValueWriter(std::ostream& stream);
+    ValueWriter(const ValueWriter&) = delete;
+    ValueWriter& operator=(const ValueWriter&) = delete;
+
+    template <typename T>
+    void write(T value) {
+        if (!direct || sizeof(T) == 1) {
+            out << value << " ";
+            return;
+        }
+        if (used + std::numeric_limits<T>::digits10 + 3 > sizeof(buffer)) flush();
+        char* end = std::to_chars(buffer + used, buffer + sizeof(buffer), value).ptr;
+        *end = ' ';
+        used = end + 1 - buffer;
+    }
+    void flush();
+};
+
+ValueWriter::ValueWriter(std::ostream& stream) : out(stream), direct(false), used(0) {
+    const std::ios_base::fmtflags special = std::ios_base::oct | std::ios_base::hex | std::ios_base::showpos |
+                                            std::ios_base::unitbuf;
+    direct = out.good() && out.rdbuf() != nullptr && !(out.flags() & special) && out.width() == 0 &&
+             out.getloc() == std::locale::classic();
+    if (direct && out.tie() != nullptr) out.tie()->flush();
+}
+
+void ValueWriter::flush() {
+    if (used == 0) return;
+    if (out.rdbuf()->sputn(buffer, used) != static_cast<std::streamsize>(used)) out.setstate(std::ios_base::badbit);
+    used = 0;
+}
+
+class LinkedList {
+private:
+    struct Node {
+        int data;
+        Node* next;
+        Node(int val) : data(val), next(nullptr) {}
+    };
+
+public:
+    // Slab allocator for list nodes. Nodes are carved out of blocks that
+    // double in size, freed nodes go on a free list threaded through
+    // Node::next, and release() drops every block at once. A pool can be
+    // shared by several lists as long as they all live on one thread.
+    class NodePool {
+    private:
+        std::vector<Node*> blocks;
+        Node* freeList;
+        size_t blockSize;
+        size_t nextInBlock;
+        size_t served;
+
+    public:
+        NodePool() : freeList(nullptr), blockSize(0), nextInBlock(0), served(0) {}
+        ~NodePool() { release(); }
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+        Node* allocate(int value);
+        void recycle(Node* first, Node* last);
+        void release();
+        void swap(NodePool& other);
+        size_t blockCount() const { return blocks.size(); }
+        size_t nodesServed() const { return served; }
+        // Pool shared by every list on the calling thread that opts in.
+        // Those lists must be destroyed before the thread exits.
+        static NodePool& forThisThread();
+    };
+
+private:
+    Node* head;
+    Node* tail;
+    NodePool ownPool;
+    NodePool* pool;
+
+    void clear();
+
+public:
+    LinkedList() : head(nullptr), tail(nullptr), pool(&ownPool) {}
+    explicit LinkedList(NodePool& shared) : head(nullptr), tail(nullptr), pool(&shared) {}
+    LinkedList(const LinkedList& other);
+    LinkedList(LinkedList&& other) noexcept;
+    ~LinkedList();
+    void insert(int value);
+    void remove(int value);
+    bool contains(int value) const;
+    LinkedList& operator=(const LinkedList& other);
+    LinkedList& operator=(LinkedList&& other) noexcept;
+    friend std::ostream& operator<<(std::ostream& out, const LinkedList& list);
+};
+
+LinkedList::Node* LinkedList::NodePool::allocate(int value) {
+    ++served;
+    Node* node;
+    if (freeList != nullptr) {
+        node = freeList;
+        freeList = freeList->next;
+    } else {
+        if (nextInBlock == blockSize) {
+            blockSize = blockSize == 0 ? 16 : std::min<size_t>(blockSize * 2, 4096);
+            blocks.push_back(static_cast<Node*>(::operator new(blockSize * sizeof(Node))));
+            nextInBlock = 0;
+        }
+        node = blocks.back() + nextInBlock++;
+    }
+    return new (node) Node(value);
+}
+
+void LinkedList::NodePool::recycle(Node* first, Node* last) {
+    if (first == nullptr) return;
+    last->next = freeList;
+    freeList = first;
+}
+
+void LinkedList::NodePool::release() {
+    for (Node* block : blocks) {
+        ::operator delete(block);
+    }
+    blocks.clear();
+    freeList = nullptr;
+    blockSize = 0;
+    nextInBlock = 0;
+}
+
+void LinkedList::NodePool::swap(NodePool& other) {
+    blocks.swap(other.blocks);
+    std::swap(freeList, other.freeList);
+    std::swap(blockSize, other.blockSize);
+    std::swap(nextInBlock, other.nextInBlock);
+    std::swap(served, other.served);
+}
+
+LinkedList::NodePool& LinkedList::NodePool::forThisThread() {
+    static thread_local NodePool pool;
+    return pool;
+}
+
+// Lists that own their pool drop its blocks; lists on a shared pool hand
+// the whole chain back in one splice. Neither walks the nodes.
+void LinkedList::clear() {
+    if (pool == &ownPool) {
+        ownPool.release();
+    } else {
+        pool->recycle(head, tail);
+    }
+    head = nullptr;
+    tail = nullptr;
+}
+
+LinkedList::LinkedList(const LinkedList& other)
+    : head(nullptr), tail(nullptr), pool(other.pool == &other.ownPool ? &ownPool : other.pool) {
+    *this = other;
+}
+
+LinkedList::LinkedList(LinkedList&& other) noexcept : head(nullptr), tail(nullptr), pool(&ownPool) {
+    *this = std::move(other);
+}
+
+LinkedList::~LinkedList() {
+    clear();
+}
+
+void LinkedList::insert(int value) {
+    if (contains(value)) return;
+    Node* newNode = pool->allocate(value);
+    newNode->next = head;
+    head = newNode;
+    if (tail == nullptr) tail = newNode;
+}
+
+void LinkedList::remove(int value) {
+    Node* current = head;
+    Node* prev = nullptr;
+    while (current != nullptr) {
+        if (current->data == value) {
+            if (prev == nullptr) {
+                head = current->next;
+            } else {
+                prev->next = current->next;
+            }
+            if (current == tail) tail = prev;
+            pool->recycle(current, current);
+            return;
+        }
+        prev = current;
+        current = current->next;
+    }
+}
+
+bool LinkedList::contains(int value) const {
+    Node* current = head;
+    while (current != nullptr) {
+        if (current->data == value) {
+            return true;
+        }
+        current = current->next;
+    }
+    return false;
+}
+
+LinkedList& LinkedList::operator=(const LinkedList& other) {
+    if (this != &other) {
+        clear();
+        Node* current = other.head;
+        while (current != nullptr) {
+            Node* newNode = pool->allocate(current->data);
+            if (tail == nullptr) {
+                head = newNode;
+            } else {
+                tail->next = newNode;
+            }
+            tail = newNode;
+            current = current->next;
+        }
+    }
+    return *this;
+}
+
+// Takes over the nodes together with the pool they came from, so nothing is
+// copied or allocated.
+LinkedList& LinkedList::operator=(LinkedList&& other) noexcept {
+    if (this != &other) {
+        clear();
+        if (other.pool == &other.ownPool) {
+            ownPool.swap(other.ownPool);
+            pool = &ownPool;
+        } else {
+            pool = other.pool;
+        }
+        head = other.head;
+        tail = other.tail;
+        other.head = nullptr;
+        other.tail = nullptr;
+    }
+    return *this;
+}
+
+std::ostream& operator<<(std::ostream& out, const LinkedList& list) {
+    LinkedList::Node* current = list.head;
+    ValueWriter writer(out);
+    while (current != nullptr) {
+        writer.write(current->data);
+        current = current->next;
+    }
+    writer.flush();
+    return out;
+}
+
+// Unrolled variant of LinkedList with the same ordering: newest element
+// first. Every node fills one cache line with a small array of values,
+// kept oldest to newest, so scans read contiguous memory and a node is
+// allocated once per CAPACITY inserts.
+class UnrolledLinkedList {
+private:
+    static const size_t CACHE_LINE = 64;
+    static const int CAPACITY = static_cast<int>((CACHE_LINE - sizeof(void*) - sizeof(int)) / sizeof(int));
+    struct alignas(CACHE_LINE) Node {
+        int values[CAPACITY];
+        int count;
+        Node* next;
+        Node() : count(0), next(nullptr) {}
+    };
+    Node* head;
+
+    void clear();
+    void mergeWithNext(Node* node);
+
+public:
+    UnrolledLinkedList() : head(nullptr) {}
+    UnrolledLinkedList(const UnrolledLinkedList& other);
+    UnrolledLinkedList(UnrolledLinkedList&& other) noexcept : head(other.head) { other.head = nullptr; }
+    ~UnrolledLinkedList() { clear(); }
+    void insert(int value);
+    void remove(int value);
+    bool contains(int value) const;
+    UnrolledLinkedList& operator=(const UnrolledLinkedList& other);
+    UnrolledLinkedList& operator=(UnrolledLinkedList&& other) noexcept;
+    friend std::ostream& operator<<(std::ostream& out, const UnrolledLinkedList& list);
+};
+
+void UnrolledLinkedList::clear() {
+    while (head != nullptr) {
+        Node* next = head->next;
+        delete head;
+        head = next;
+    }
+}
+
+UnrolledLinkedList::UnrolledLinkedList(const UnrolledLinkedList& other) : head(nullptr) {
+    *this = other;
+}
+
+void UnrolledLinkedList::insert(int value) {
+    if (contains(value)) return;
+    if (head == nullptr || head->count == CAPACITY) {
+        Node* newNode = new Node();
+        newNode->next = head;
+        head = newNode;
+    }
+    head->values[head->count++] = value;
+}
+
+// Folds the next (older) node into this one once both fit in a single node,
+// so removals do not leave a trail of nearly empty nodes.
+void UnrolledLinkedList::mergeWithNext(Node* node) {
+    Node* next = node->next;
+    if (next == nullptr || node->count + next->count > CAPACITY) return;
+    std::copy_backward(node->values, node->values + node->count, node->values + node->count + next->count);
+    std::copy(next->values, next->values + next->count, node->values);
+    node->count += next->count;
+    node->next = next->next;
+    delete next;
+}
+
+void UnrolledLinkedList::remove(int value) {
+    Node* current = head;
+    Node* prev = nullptr;
+    while (current != nullptr) {
+        int* end = current->values + current->count;
+        int* found = std::find(current->values, end, value);
+        if (found != end) {
+            std::copy(found + 1, end, found);
+            --current->count;
+            if (current->count == 0) {
+                if (prev == nullptr) {
+                    head = current->next;
+                } else {
+                    prev->next = current->next;
+                }
+                delete current;
+            } else {
+                mergeWithNext(current);
+            }
+            return;
+        }
+        prev = current;
+        current = current->next;
+    }
+}
+
+bool UnrolledLinkedList::contains(int value) const {
+    for (Node* current = head; current != nullptr; current = current->next) {
+        // No early exit inside a node, so the compare loop vectorizes.
+        bool found = false;
+        for (int i = 0; i < current->count; ++i) {
+            found |= current->values[i] == value;
+        }
+        if (found) return true;
+    }
+    return false;
+}
+
+UnrolledLinkedList& UnrolledLinkedList::operator=(const UnrolledLinkedList& other) {
+    if (this != &other) {
+        clear();
+        Node* tail = nullptr;
+        for (Node* current = other.head; current != nullptr; current = current->next) {
+            Node* newNode = new Node(*current);
+            newNode->next = nullptr;
+            if (tail == nullptr) {
+                head = newNode;
+            } else {
+                tail->next = newNode;
+            }
+            tail = newNode;
+        }
+    }
+    return *this;
+}
+
+UnrolledLinkedList& UnrolledLinkedList::operator=(UnrolledLinkedList&& other) noexcept {
+    if (this != &other) {
+        clear();
+        head = other.head;
+        other.head = nullptr;
+    }
+    return *this;
+}
+
+std::ostream& operator<<(std::ostream& out, const UnrolledLinkedList& list) {
+    ValueWriter writer(out);
+    for (UnrolledLinkedList::Node* current = list.head; current != nullptr; current = current->next) {
+        for (int i = current->count - 1; i >= 0; --i) {
+            writer.write(current->values[i]);
+        }
+    }
+    writer.flush();
+    return out;
+}
+
+// Open-addressing table with linear probing over contiguous slots of an
+// integer type. The type's minimum marks an empty slot, so that value is
+// tracked with a separate flag. HashTable is the int instance Set uses.
+// Deletion shifts the following cluster back instead of leaving tombstones.
+// The first INLINE_CAPACITY values live in an array inside the table, so a
+// small table never allocates; the first insert past that moves them into
+// heap slots, which the table then keeps.
+template <typename T>
+class BasicHashTable {
+public:
+    static constexpr size_t INLINE_CAPACITY = SET_INLINE_CAPACITY;
+
+private:
+    static constexpr T EMPTY = std::numeric_limits<T>::min();
+    std::vector<T> slots;
+    size_t count;
+    bool hasEmptyKey;
+    // Unused entries hold EMPTY, so contains can compare the whole array
+    // without a data-dependent exit and the loop vectorizes.
+    T small[INLINE_CAPACITY > 0 ? INLINE_CAPACITY : 1];
+
+    bool isInline() const { return slots.empty(); }
+    void resetInline() { std::fill(small, small + sizeof(small) / sizeof(T), EMPTY); }
+
+    size_t indexFor(T value) const { return homeSlot(value, slots.size() - 1); }
+    void rehash(size_t capacity);
+
+public:
+    typedef T value_type;
+    BasicHashTable() : count(0), hasEmptyKey(false) { resetInline(); }
+    BasicHashTable(const BasicHashTable& other) = default;
+    BasicHashTable(BasicHashTable&& other) noexcept;
+    BasicHashTable& operator=(const BasicHashTable& other) = default;
+    BasicHashTable& operator=(BasicHashTable&& other) noexcept;
+    bool insert(T value);
+    size_t insertBatch(const T* values, size_t n);
+    void fillParallel(const T* values, size_t n, unsigned threads);
+    bool remove(T value);
+    bool contains(T value) const;
+    void containsBatch(const T* values, size_t n, bool* out) const;
+    void reserve(size_t n);
+    // Takes over a slot array laid out by this table's probing scheme, for
+    // instance one filled by ConcurrentSet, without rehashing it.
+    void adopt(std::vector<T>& filled, size_t used);
+    size_t size() const { return count + (hasEmptyKey ? 1 : 0); }
+    static size_t homeSlot(T value, size_t mask);
+
+    template <typename F>
+    void forEach(F f) const {
+        if (hasEmptyKey) f(EMPTY);
+        if (isInline()) {
+            for (size_t i = 0; i < count; ++i) f(small[i]);
+        }
+        for (T value : slots) {
+            if (value != EMPTY) f(value);
+        }
+    }
+};
+
+template <typename T>
+BasicHashTable<T>::BasicHashTable(BasicHashTable&& other) noexcept
+    : slots(std::move(other.slots)), count(other.count), hasEmptyKey(other.hasEmptyKey) {
+    std::copy(other.small, other.small + sizeof(small) / sizeof(T), small);
+    other.slots.clear();
+    other.count = 0;
+    other.hasEmptyKey = false;
+    other.resetInline();
+}
+
+template <typename T>
+BasicHashTable<T>& BasicHashTable<T>::operator=(BasicHashTable&& other) noexcept {
+    if (this != &other) {
+        slots.swap(other.slots);
+        other.slots.clear();
+        count = other.count;
+        hasEmptyKey = other.hasEmptyKey;
+        std::copy(other.small, other.small + sizeof(small) / sizeof(T), small);
+        other.count = 0;
+        other.hasEmptyKey = false;
+        other.resetInline();
+    }
+    return *this;
+}
+
+template <typename T>
+size_t BasicHashTable<T>::homeSlot(T value, size_t mask) {
+    // Folding the upper half in first lets 64-bit keys that differ only in
+    // their high bits still spread; for 32-bit keys it is a no-op. The salt
+    // differs with the capacity, so tables of different sizes order their
+    // values unrelatedly. Without it, values inserted in the slot order of
+    // a larger table (a set read back from its own text output) pile into
+    // one end of the smaller one and the probe runs grow without bound.
+    uint64_t key = static_cast<uint64_t>(static_cast<typename std::make_unsigned<T>::type>(value));
+    uint64_t multiplier = 0x9E3779B97F4A7C15ull + (uint64_t(mask) << 1) * 0xD6E8FEB86659FD93ull;
+    uint64_t h = (key ^ (key >> 32)) * multiplier;
+    return static_cast<size_t>(h >> 32) & mask;
+}
+
+template <typename T>
+void BasicHashTable<T>::adopt(std::vector<T>& filled, size_t used) {
+    slots.swap(filled);
+    filled.clear();
+    count = used;
+    hasEmptyKey = false;
+    resetInline();
+}
+
+template <typename T>
+void BasicHashTable<T>::rehash(size_t capacity) {
+    std::vector<T> old(capacity, EMPTY);
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    if (old.empty()) {
+        old.assign(small, small + count);
+        resetInline();
+    }
+    for (T value : old) {
+        if (value == EMPTY) continue;
+        size_t i = indexFor(value);
+        while (slots[i] != EMPTY) i = (i + 1) & mask;
+        slots[i] = value;
+    }
+}
+
+template <typename T>
+void BasicHashTable<T>::reserve(size_t n) {
+    if (n <= count || (isInline() && n <= INLINE_CAPACITY)) return;
+    size_t capacity = std::max<size_t>(slots.size(), 16);
+    while (n * 10 >= capacity * 7) capacity *= 2;
+    if (capacity != slots.size()) rehash(capacity);
+}
+
+template <typename T>
+bool BasicHashTable<T>::insert(T value) {
+    if (value == EMPTY) {
+        if (hasEmptyKey) return false;
+        hasEmptyKey = true;
+        return true;
+    }
+    if (isInline()) {
+        if (contains(value)) return false;
+        if (count < INLINE_CAPACITY) {
+            small[count++] = value;
+            return true;
+        }
+        reserve(count + 1);
+    }
+    if ((count + 1) * 10 >= slots.size() * 7) rehash(std::max<size_t>(slots.size() * 2, 16));
+    size_t mask = slots.size() - 1;
+    size_t i = indexFor(value);
+    while (slots[i] != EMPTY) {
+        if (slots[i] == value) return false;
+        i = (i + 1) & mask;
+    }
+    slots[i] = value;
+    ++count;
+    return true;
+}
+
+// Reserves room for the whole batch up front and prefetches the home slot
+// a few values ahead, so the cache misses of consecutive inserts overlap.
+template <typename T>
+size_t BasicHashTable<T>::insertBatch(const T* values, size_t n) {
+    const size_t ahead = 16;
+    size_t added = 0;
+    reserve(count + n);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + ahead < n && !isInline()) __builtin_prefetch(&slots[indexFor(values[i + ahead])]);
+        if (insert(values[i])) ++added;
+    }
+    return added;
+}
+
+// Lookups in the same style: the home slot of a value a few positions
+// ahead is prefetched, so up to that many cache misses are in flight.
+template <typename T>
+void BasicHashTable<T>::containsBatch(const T* values, size_t n, bool* out) const {
+    const size_t ahead = 16;
+    for (size_t i = 0; i < n; ++i) {
+        if (i + ahead < n && !isInline()) __builtin_prefetch(&slots[indexFor(values[i + ahead])]);
+        out[i] = contains(values[i]);
+    }
+}
+
+// Fills an empty table from distinct values on several threads. The slots
+// are split into one region per thread and every value is routed to the
+// thread that owns its home slot. The few values whose probe would run
+// past the end of their region are inserted afterwards on this thread.
+template <typename T>
+void BasicHashTable<T>::fillParallel(const T* values, size_t n, unsigned threads) {
+    if (n <= INLINE_CAPACITY) {
+        insertBatch(values, n);
+        return;
+    }
+    reserve(n);
+    size_t capacity = slots.size();
+    std::vector<size_t> offsets(size_t(threads) * threads + 1, 0);
+    auto regionOf = [&](T value) { return indexFor(value) * threads / capacity; };
+    auto chunkBegin = [&](unsigned c) { return n * c / threads; };
+    std::vector<std::thread> workers;
+    for (unsigned c = 0; c < threads; ++c) {
+        workers.emplace_back([&, c] {
+            for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i) {
+                if (values[i] != EMPTY) ++offsets[regionOf(values[i]) * threads + c + 1];
+            }
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    // offsets is laid out region-major, so one prefix sum gives every chunk
+    // its own write position inside each region's bucket.
+    for (size_t k = 1; k < offsets.size(); ++k) offsets[k] += offsets[k - 1];
+    std::vector<T> bucketed(offsets.back());
+    workers.clear();
+    for (unsigned c = 0; c < threads; ++c) {
+        workers.emplace_back([&, c] {
+            std::vector<size_t> next(threads);
+            for (unsigned r = 0; r < threads; ++r) next[r] = offsets[r * threads + c];
+            for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i) {
+                if (values[i] != EMPTY) bucketed[next[regionOf(values[i])]++] = values[i];
+            }
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    std::vector<std::vector<T>> overflow(threads);
+    workers.clear();
+    for (unsigned r = 0; r < threads; ++r) {
+        workers.emplace_back([&, r] {
+            size_t regionEnd = capacity * (r + 1) / threads;
+            for (size_t k = offsets[size_t(r) * threads]; k < offsets[size_t(r + 1) * threads]; ++k) {
+                size_t i = indexFor(bucketed[k]);
+                while (i < regionEnd && slots[i] != EMPTY) ++i;
+                if (i < regionEnd) {
+                    slots[i] = bucketed[k];
+                } else {
+                    overflow[r].push_back(bucketed[k]);
+                }
+            }
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    size_t spilled = 0;
+    for (const std::vector<T>& spill : overflow) spilled += spill.size();
+    count += bucketed.size() - spilled;
+    for (const std::vector<T>& spill : overflow) {
+        for (T value : spill) insert(value);
+    }
+    if (bucketed.size() != n) hasEmptyKey = true;
+}
+
+template <typename T>
+bool BasicHashTable<T>::remove(T value) {
+    if (value == EMPTY) {
+        bool had = hasEmptyKey;
+        hasEmptyKey = false;
+        return had;
+    }
+    if (isInline()) {
+        T* end = small + count;
+        T* found = std::find(small, end, value);
+        if (found == end) return false;
+        *found = small[--count];
+        small[count] = EMPTY;
+        return true;
+    }
+    size_t mask = slots.size() - 1;
+    size_t i = indexFor(value);
+    while (slots[i] != value) {
+        if (slots[i] == EMPTY) return false;
+        i = (i + 1) & mask;
+    }
+    // Pull back every later entry of the cluster whose home slot is not
+    // between the hole and its current position.
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (slots[j] == EMPTY) break;
+        size_t home = indexFor(slots[j]);
+        bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = EMPTY;
+    --count;
+    return true;
+}
+
+template <typename T>
+bool BasicHashTable<T>::contains(T value) const {
+    if (value == EMPTY) return hasEmptyKey;
+    if (isInline()) {
+        bool found = false;
+        for (size_t i = 0; i < INLINE_CAPACITY; ++i) found |= small[i] == value;
+        return found;
+    }
+    size_t mask = slots.size() - 1;
+    size_t i = indexFor(value);
+    while (slots[i] != EMPTY) {
+        if (slots[i] == value) return true;
+        i = (i + 1) & mask;
+    }
+    return false;
+}
+
+typedef BasicHashTable<int> HashTable;
+
+// Merge kernels over sorted, duplicate-free arrays.
+size_t mergeUnion(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    size_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            out[count++] = a[i++];
+        } else if (b[j] < a[i]) {
+            out[count++] = b[j++];
+        } else {
+            out[count++] = a[i++];
+            ++j;
+        }
+    }
+    int* end = std::copy(a + i, a + na, out + count);
+    end = std::copy(b + j, b + nb, end);
+    return end - out;
+}
+
+// Intersection kernels. Each one takes two sorted, duplicate-free arrays
+// and returns the size of the intersection. If out is not null the common
+// elements are also written there; the SIMD kernels store whole vectors,
+// so out needs min(na, nb) + 8 ints of room.
+size_t intersectScalar(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    size_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            if (out) out[count] = a[i];
+            ++count;
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+// Every element of small is located in large by an exponential search
+// starting just past the previous match.
+size_t intersectGallop(const int* small, size_t ns, const int* large, size_t nl, int* out) {
+    size_t lo = 0, count = 0;
+    for (size_t k = 0; k < ns; ++k) {
+        int value = small[k];
+        size_t step = 1;
+        while (lo + step < nl && large[lo + step] < value) step *= 2;
+        size_t hi = std::min(lo + step + 1, nl);
+        lo = std::lower_bound(large + lo + step / 2, large + hi, value) - large;
+        if (lo == nl) break;
+        if (large[lo] == value) {
+            if (out) out[count] = value;
+            ++count;
+        }
+    }
+    return count;
+}
+
+#ifdef SET_X86_SIMD
+// Block-compare kernels after Lemire and Schlegel: a block of a is compared
+// against every rotation of a block of b, the match mask picks the common
+// elements through a shuffle table, and whichever block has the smaller
+// maximum is advanced.
+struct ShuffleTables {
+    alignas(16) unsigned char sse[16][16];
+    alignas(32) int avx2[256][8];
+    ShuffleTables();
+};
+
+ShuffleTables::ShuffleTables() {
+    for (int mask = 0; mask < 16; ++mask) {
+        int k = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            if (!(mask & (1 << lane))) continue;
+            for (int b = 0; b < 4; ++b) sse[mask][k * 4 + b] = static_cast<unsigned char>(lane * 4 + b);
+            ++k;
+        }
+        for (; k < 4; ++k) {
+            for (int b = 0; b < 4; ++b) sse[mask][k * 4 + b] = 0x80;
+        }
+    }
+    for (int mask = 0; mask < 256; ++mask) {
+        int k = 0;
+        for (int lane = 0; lane < 8; ++lane) {
+            if (mask & (1 << lane)) avx2[mask][k++] = lane;
+        }
+        for (; k < 8; ++k) avx2[mask][k] = 0;
+    }
+}
+
+const ShuffleTables shuffleTables;
+
+__attribute__((target("sse4.2,popcnt")))
+size_t intersectSse(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    size_t i = 0, j = 0, count = 0;
+    size_t na4 = na & ~size_t(3), nb4 = nb & ~size_t(3);
+    while (i < na4 && j < nb4) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(hits));
+        if (mask) {
+            if (out) {
+                __m128i pick = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffleTables.sse[mask]));
+                __m128i packed = _mm_shuffle_epi8(va, pick);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + count), packed);
+            }
+            count += _mm_popcnt_u32(mask);
+        }
+        int amax = a[i + 3], bmax = b[j + 3];
+        if (amax <= bmax) i += 4;
+        if (bmax <= amax) j += 4;
+    }
+    return count + intersectScalar(a + i, na - i, b + j, nb - j, out ? out + count : nullptr);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t intersectAvx2(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    size_t i = 0, j = 0, count = 0;
+    size_t na8 = na & ~size_t(7), nb8 = nb & ~size_t(7);
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    while (i < na8 && j < nb8) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+        __m256i hits = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; ++r) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi32(va, vb));
+        }
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+        if (mask) {
+            if (out) {
+                __m256i pick = _mm256_load_si256(reinterpret_cast<const __m256i*>(shuffleTables.avx2[mask]));
+                __m256i packed = _mm256_permutevar8x32_epi32(va, pick);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + count), packed);
+            }
+            count += _mm_popcnt_u32(mask);
+        }
+        int amax = a[i + 7], bmax = b[j + 7];
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+    return count + intersectSse(a + i, na - i, b + j, nb - j, out ? out + count : nullptr);
+}
+#endif
+
+typedef size_t (*IntersectKernel)(const int*, size_t, const int*, size_t, int*);
+
+IntersectKernel selectIntersectKernel() {
+#ifdef SET_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return intersectAvx2;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) return intersectSse;
+#endif
+    return intersectScalar;
+}
+
+const IntersectKernel intersectKernel = selectIntersectKernel();
+
+const size_t GALLOP_RATIO = 32;
+const size_t PARALLEL_THRESHOLD = 1 << 20;
+const size_t INPUT_BATCH = 1 << 16;
+// Values per call when one table is walked and fed to the batch lookups or
+// inserts of another; small enough to live on the stack.
+const size_t PROBE_BLOCK = 256;
+
+// LSD radix sort on the sign-flipped bits, three passes of 11 bits.
+void radixSort(int* first, int* last, std::vector<int>& scratch) {
+    size_t n = last - first;
+    if (n < 256) {
+        std::sort(first, last);
+        return;
+    }
+    scratch.resize(n);
+    int* src = first;
+    int* dst = scratch.data();
+    for (int shift = 0; shift < 32; shift += 11) {
+        size_t counts[2048] = {0};
+        for (size_t i = 0; i < n; ++i) {
+            ++counts[((static_cast<uint32_t>(src[i]) ^ 0x80000000u) >> shift) & 2047];
+        }
+        size_t offset = 0;
+        for (size_t& c : counts) {
+            size_t next = offset + c;
+            c = offset;
+            offset = next;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            dst[counts[((static_cast<uint32_t>(src[i]) ^ 0x80000000u) >> shift) & 2047]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+    // Three passes leave the result in the scratch buffer.
+    std::copy(src, src + n, first);
+}
+
+// Threads to use for a bulk operation on n values.
+unsigned workerCount(size_t n) {
+    unsigned cores = std::thread::hardware_concurrency();
+    return n < PARALLEL_THRESHOLD || cores < 2 ? 1 : cores;
+}
+
+// Sorts equal slices on separate threads, then merges neighbouring slices
+// pairwise, also in parallel, until one sorted run is left. threads == 0
+// picks the count with workerCount.
+void parallelSort(std::vector<int>& values, unsigned threads = 0) {
+    size_t parts = threads != 0 ? threads : workerCount(values.size());
+    if (parts < 2) {
+        std::vector<int> scratch;
+        radixSort(values.data(), values.data() + values.size(), scratch);
+        return;
+    }
+    std::vector<size_t> bounds(parts + 1);
+    for (size_t i = 0; i <= parts; ++i) bounds[i] = values.size() * i / parts;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < parts; ++i) {
+        workers.emplace_back([&values, &bounds, i] {
+            std::vector<int> scratch;
+            radixSort(values.data() + bounds[i], values.data() + bounds[i + 1], scratch);
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    for (size_t width = 1; width < parts; width *= 2) {
+        workers.clear();
+        for (size_t i = 0; i + width < parts; i += 2 * width) {
+            size_t lo = bounds[i], mid = bounds[i + width], hi = bounds[std::min(i + 2 * width, parts)];
+            workers.emplace_back([&values, lo, mid, hi] {
+                std::inplace_merge(values.begin() + lo, values.begin() + mid, values.begin() + hi);
+            });
+        }
+        for (std::thread& t : workers) t.join();
+    }
+}
+
+// Picks galloping for lopsided inputs and the dispatched block kernel
+// otherwise. Passing a null out only counts.
+size_t intersectSorted(const int* a, size_t na, const int* b, size_t nb, int* out) {
+    if (na * GALLOP_RATIO < nb) return intersectGallop(a, na, b, nb, out);
+    if (nb * GALLOP_RATIO < na) return intersectGallop(b, nb, a, na, out);
+    return intersectKernel(a, na, b, nb, out);
+}
+
+size_t intersectSorted(const std::vector<int>& a, const std::vector<int>& b, int* out) {
+    return intersectSorted(a.data(), a.size(), b.data(), b.size(), out);
+}
+
+// Range-partitioned merge for the parallel set operators. Splitters taken
+// from the larger input cut both sorted arrays into one shard per thread,
+// each shard is merged into its own buffer, and the buffers are then copied
+// to their prefix-sum offsets in out. No step takes a lock.
+template <typename Kernel>
+void shardedMerge(const std::vector<int>& a, const std::vector<int>& b, unsigned threads,
+                  Kernel kernel, std::vector<int>& out) {
+    const std::vector<int>& larger = a.size() >= b.size() ? a : b;
+    if (larger.size() < threads) threads = 1;
+    std::vector<size_t> aBounds(threads + 1), bBounds(threads + 1);
+    aBounds[threads] = a.size();
+    bBounds[threads] = b.size();
+    for (unsigned k = 1; k < threads; ++k) {
+        int splitter = larger[larger.size() * k / threads];
+        aBounds[k] = std::lower_bound(a.begin(), a.end(), splitter) - a.begin();
+        bBounds[k] = std::lower_bound(b.begin(), b.end(), splitter) - b.begin();
+    }
+    std::vector<std::vector<int>> shards(threads);
+    std::vector<std::thread> workers;
+    for (unsigned k = 0; k < threads; ++k) {
+        workers.emplace_back([&, k] {
+            const int* sa = a.data() + aBounds[k];
+            const int* sb = b.data() + bBounds[k];
+            size_t na = aBounds[k + 1] - aBounds[k], nb = bBounds[k + 1] - bBounds[k];
+            shards[k].resize(na + nb + 8);
+            shards[k].resize(kernel(sa, na, sb, nb, shards[k].data()));
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    std::vector<size_t> offsets(threads + 1, 0);
+    for (unsigned k = 0; k < threads; ++k) offsets[k + 1] = offsets[k] + shards[k].size();
+    out.resize(offsets[threads]);
+    workers.clear();
+    for (unsigned k = 0; k < threads; ++k) {
+        workers.emplace_back([&, k] { std::copy(shards[k].begin(), shards[k].end(), out.begin() + offsets[k]); });
+    }
+    for (std::thread& t : workers) t.join();
+}
+
+// Blocked Bloom filter. Every value hashes to one 32-byte block and sets a
+// bit in each of its eight words, picked by eight odd multipliers, so a
+// probe reads a single cache line and the eight word tests vectorize. It
+// never reports a false negative; removed values keep their bits until the
+// filter is rebuilt.
+class BlockedBloomFilter {
+private:
+    struct alignas(32) Block {
+        uint32_t words[8];
+    };
+    static constexpr uint32_t SALT[8] = {0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+                                         0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+    std::vector<Block> blocks;
+    size_t capacity;
+    size_t added;
+    unsigned bits;
+
+    static uint64_t hash(int value) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(value)) * 0x9E3779B97F4A7C15ull;
+    }
+    size_t blockIndex(uint64_t h) const { return static_cast<size_t>(((h >> 32) * blocks.size()) >> 32); }
+    bool probe(uint64_t h) const;
+
+public:
+    BlockedBloomFilter() : capacity(0), added(0), bits(0) {}
+    // Sizes the filter for the given number of values at bitsPerValue bits
+    // each and clears it.
+    void reset(size_t expected, unsigned bitsPerValue);
+    void clear();
+    bool enabled() const { return !blocks.empty(); }
+    unsigned bitsPerValue() const { return bits; }
+    // True once more values went in than the filter was sized for.
+    bool full() const { return added > capacity; }
+    void insert(int value);
+    bool mayContain(int value) const { return probe(hash(value)); }
+    void mayContainBatch(const int* values, size_t n, bool* out) const;
+};
+
+constexpr uint32_t BlockedBloomFilter::SALT[8];
+
+void BlockedBloomFilter::reset(size_t expected, unsigned bitsPerValue) {
+    capacity = std::max<size_t>(expected, 1024);
+    added = 0;
+    bits = bitsPerValue;
+    blocks.assign((capacity * bits + 255) / 256, Block());
+}
+
+void BlockedBloomFilter::clear() {
+    blocks.clear();
+    capacity = 0;
+    added = 0;
+    bits = 0;
+}
+
+void BlockedBloomFilter::insert(int value) {
+    uint64_t h = hash(value);
+    Block& block = blocks[blockIndex(h)];
+    uint32_t key = static_cast<uint32_t>(h);
+    for (int i = 0; i < 8; ++i) block.words[i] |= 1u << ((key * SALT[i]) >> 27);
+    ++added;
+}
+
+bool BlockedBloomFilter::probe(uint64_t h) const {
+    const Block& block = blocks[blockIndex(h)];
+    uint32_t key = static_cast<uint32_t>(h);
+    uint32_t missing = 0;
+    for (int i = 0; i < 8; ++i) missing |= ~block.words[i] & (1u << ((key * SALT[i]) >> 27));
+    return missing == 0;
+}
+
+// Prefetches the block of a value a few positions ahead, as insertBatch
+// does for table slots.
+void BlockedBloomFilter::mayContainBatch(const int* values, size_t n, bool* out) const {
+    const size_t ahead = 16;
+    for (size_t i = 0; i < n; ++i) {
+        if (i + ahead < n) __builtin_prefetch(&blocks[blockIndex(hash(values[i + ahead]))]);
+        out[i] = probe(hash(values[i]));
+    }
+}
+
+// One-permutation MinHash. The top bits of a value's 64-bit hash pick one
+// of the bins and the bin keeps the smallest hash it has seen, so an insert
+// is one hash and one compare however many bins there are. Two sketches of
+// the same width estimate the Jaccard similarity of their sets as the share
+// of bins, among those either one filled, whose minima agree; the error
+// falls as 1 / sqrt(bins). The hash is a bijection, so equal minima mean
+// the same value. A minimum cannot be taken back out, so a removal only
+// marks the sketch stale for its owner to rebuild.
+class MinHashSketch {
+private:
+    std::vector<uint64_t> mins;
+    unsigned shift;
+    bool stale;
+
+    static uint64_t hash(int value) {
+        uint64_t h = static_cast<uint32_t>(value) + 0x9E3779B97F4A7C15ull;
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+
+public:
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+
+    MinHashSketch() : shift(64), stale(false) {}
+    // Rounds bins up to a power of two, at least 16, and clears the sketch.
+    void reset(size_t bins);
+    void clear();
+    bool enabled() const { return !mins.empty(); }
+    size_t bins() const { return mins.size(); }
+    bool isStale() const { return stale; }
+    void markStale() { stale = true; }
+    void insert(int value) {
+        uint64_t h = hash(value);
+        uint64_t& least = mins[h >> shift];
+        if (h < least) least = h;
+    }
+    // Folds in the sketch of another set, giving the sketch of the union.
+    bool merge(const MinHashSketch& other);
+    // Estimated Jaccard similarity, or -1 when the widths differ.
+    double similarity(const MinHashSketch& other) const;
+};
+
+constexpr uint64_t MinHashSketch::EMPTY;
+
+void MinHashSketch::reset(size_t bins) {
+    unsigned bits = 4;
+    while ((size_t(1) << bits) < bins && bits < 32) ++bits;
+    mins.assign(size_t(1) << bits, EMPTY);
+    shift = 64 - bits;
+    stale = false;
+}
+
+void MinHashSketch::clear() {
+    mins.clear();
+    shift = 64;
+    stale = false;
+}
+
+bool MinHashSketch::merge(const MinHashSketch& other) {
+    if (other.mins.size() != mins.size()) return false;
+    for (size_t i = 0; i < mins.size(); ++i) mins[i] = std::min(mins[i], other.mins[i]);
+    return true;
+}
+
+double MinHashSketch::similarity(const MinHashSketch& other) const {
+    if (other.mins.size() != mins.size() || mins.empty()) return -1;
+    size_t filled = 0, agree = 0;
+    for (size_t i = 0; i < mins.size(); ++i) {
+        filled += mins[i] != EMPTY || other.mins[i] != EMPTY;
+        agree += mins[i] == other.mins[i] && mins[i] != EMPTY;
+    }
+    return filled ? double(agree) / filled : 1.0;
+}
+
+class Set;
+template <typename L, typename R> class UnionExpr;
+template <typename L, typename R> class IntersectionExpr;
+
+template <typename T> struct IsSetExpr : std::false_type {};
+template <typename L, typename R> struct IsSetExpr<UnionExpr<L, R>> : std::true_type {};
+template <typename L, typename R> struct IsSetExpr<IntersectionExpr<L, R>> : std::true_type {};
+
+class Set {
+private:
+    HashTable elements;
+    BlockedBloomFilter filter;
+    MinHashSketch sketch;
+
+    // Sorted copy of the elements for the merge kernels and the sorted file
+    // formats, built into the caller's vector so const sets can be shared
+    // between threads. It is sorted with parallelSort on threads threads.
+    void sortedElements(std::vector<int>& out, unsigned threads = 0) const;
+    void assignSorted(const std::vector<int>& values, unsigned threads = 1);
+    void rebuildFilter(unsigned bitsPerValue);
+    void buildSketch(MinHashSketch& out, size_t bins) const;
+    void noteInserted(const int* values, size_t n);
+    // Calls f(values, n) on the elements a PROBE_BLOCK at a time.
+    template <typename F>
+    void forEachBlock(F f) const {
+        int block[PROBE_BLOCK];
+        size_t n = 0;
+        elements.forEach([&](int value) {
+            block[n++] = value;
+            if (n == PROBE_BLOCK) {
+                f(static_cast<const int*>(block), n);
+                n = 0;
+            }
+        });
+        if (n != 0) f(static_cast<const int*>(block), n);
+    }
+
+    friend class MappedSet;
+    friend class ConcurrentSet;
+
+public:
+    Set() {}
+    Set(const int arr[], size_t size);
+    Set(const Set& other)
+        : elements(other.elements),
+          filter(other.filter),
+          sketch(other.sketch) {}
+    Set(Set&& other) noexcept;
+    // Evaluating a lazy expression: two plain sets go through the batch
+    // table calls, anything deeper in one fused pass over the tree.
+    Set(const UnionExpr<Set, Set>& e);
+    Set(const IntersectionExpr<Set, Set>& e);
+    template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+    Set(const E& e) {
+        e.forEach([this](int value) { elements.insert(value); });
+    }
+    template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+    Set& operator=(const E& e) {
+        return *this = Set(e);
+    }
+    friend std::istream& operator>>(std::istream& in, Set& s);
+    friend std::ostream& operator<<(std::ostream& out, const Set& s);
+    bool contains(int value) const {
+        return (!filter.enabled() || filter.mayContain(value)) && elements.contains(value);
+    }
+    // Answer contains for n values at once, prefetching table slots ahead
+    // of the probes. With a filter the misses are screened out in one pass
+    // before the table is touched. The mask form sets bit i % 64 of
+    // mask[i / 64] for every hit and returns the number of hits.
+    void containsBatch(const int* values, size_t n, bool* out) const;
+    size_t containsBatch(const int* values, size_t n, uint64_t* mask) const;
+    // Optional Bloom filter in front of the table, worth it when most
+    // probes miss and the table does not fit in cache. It is kept up to
+    // date by every insert and grows with the set.
+    void enableFilter(unsigned bitsPerValue = 10);
+    void disableFilter() { filter.clear(); }
+    bool hasFilter() const { return filter.enabled(); }
+    // Optional MinHash sketch for similarity estimates over sets too big to
+    // compare exactly, or held apart with only their sketches at hand. It
+    // follows inserts as they happen. A removal leaves it stale, and until
+    // enableSketch refreshes it every estimate works from a fresh copy.
+    void enableSketch(size_t bins = 256);
+    void disableSketch() { sketch.clear(); }
+    bool hasSketch() const { return sketch.enabled(); }
+    MinHashSketch similaritySketch() const;
+    size_t size() const { return elements.size(); }
+    template <typename F>
+    void forEach(F f) const {
+        elements.forEach(f);
+    }
+    // + and * on two lvalue sets build lazy expressions (see below). The
+    // overloads here work in place on a temporary operand instead, so
+    // chains like f() + b + c allocate no intermediate sets. They only take
+    // a Set, never an expression converted to one.
+    template <typename S, typename = typename std::enable_if<std::is_same<S, Set>::value>::type>
+    Set operator+(const S& other) && {
+        *this |= other;
+        return std::move(*this);
+    }
+    template <typename S, typename = typename std::enable_if<std::is_same<S, Set>::value>::type>
+    Set operator+(S&& other) const& {
+        other |= *this;
+        return std::move(other);
+    }
+    template <typename S, typename = typename std::enable_if<std::is_same<S, Set>::value>::type>
+    Set operator+(S&& other) && {
+        *this |= other;
+        return std::move(*this);
+    }
+    template <typename S, typename = typename std::enable_if<std::is_same<S, Set>::value>::type>
+    Set operator*(const S& other) && {
+        *this &= other;
+        return std::move(*this);
+    }
+    template <typename S, typename = typename std::enable_if<std::is_same<S, Set>::value>::type>
+    Set operator*(S&& other) const& {
+        other &= *this;
+        return std::move(other);
+    }
+    template <typename S, typename = typename std::enable_if<std::is_same<S, Set>::value>::type>
+    Set operator*(S&& other) && {
+        *this &= other;
+        return std::move(*this);
+    }
+    Set& operator|=(const Set& other);
+    Set& operator&=(const Set& other);
+    // Exact sizes that build nothing: the smaller table is probed against
+    // the larger one. Two empty sets have a similarity of 1.
+    size_t intersectionSize(const Set& other) const;
+    size_t unionSize(const Set& other) const;
+    double jaccard(const Set& other) const;
+    // From the sketches when both sets have one of the same width, else
+    // exact.
+    double approximateJaccard(const Set& other) const;
+    // Union and intersection of count sets in one pass each, without the
+    // intermediate sets a chain of + or * would build.
+    static Set unionAll(const Set* const sets[], size_t count);
+    static Set intersectAll(const Set* const sets[], size_t count);
+    // Sort both operands and split them into per-thread value ranges, all
+    // on threads threads; threads == 0 uses every core.
+    Set parallelUnion(const Set& other, unsigned threads = 0) const;
+    Set parallelIntersection(const Set& other, unsigned threads = 0) const;
+    // Binary file round trip; see SetFileHeader and MappedSet.
+    bool save(const char* path, bool withChecksum = true) const;
+    bool load(const char* path, bool verifyChecksum = false);
+    // Compact, endian-neutral stream form: ascending values as varint gaps.
+    // A stream that is not one leaves the set as it was and sets failbit.
+    bool writeDeltas(std::ostream& out) const;
+    bool readDeltas(std::istream& in);
+    // Adds the whitespace-separated ints of a text file, parsed on threads
+    // threads (0: every core). False, with the set unchanged, when the file
+    // cannot be read or holds anything else.
+    bool ingestFile(const char* path, unsigned threads = 0);
+    Set& operator+=(int value);
+    Set& operator-=(int value);
+    Set& operator=(const Set& other);
+    Set& operator=(Set&& other) noexcept;
+};
+
+// Lazy set algebra. + and * on sets or expressions build a small tree that
+// is only evaluated when it is assigned to a Set or streamed out. Named sets
+// are held by reference, so a tree must not outlive them and it sees later
+// changes to them. Sub-expressions, and temporary sets moved in as an
+// OwnedSet, are held by value.
+template <typename T> struct ExprOperand { typedef T type; };
+template <> struct ExprOperand<Set> { typedef const Set& type; };
+
+class OwnedSet {
+private:
+    Set set;
+
+public:
+    explicit OwnedSet(Set&& s) : set(std::move(s)) {}
+    bool contains(int value) const { return set.contains(value); }
+    size_t sizeBound() const { return set.size(); }
+
+    template <typename F>
+    void forEach(F f) const {
+        set.forEach(f);
+    }
+};
+
+inline size_t sizeBound(const Set& s) { return s.size(); }
+
+template <typename E>
+size_t sizeBound(const E& e) { return e.sizeBound(); }
+
+template <typename L, typename R>
+class UnionExpr {
+private:
+    typename ExprOperand<L>::type lhs;
+    typename ExprOperand<R>::type rhs;
+
+public:
+    UnionExpr(typename ExprOperand<L>::type l, typename ExprOperand<R>::type r) : lhs(std::move(l)), rhs(std::move(r)) {}
+    const L& left() const { return lhs; }
+    const R& right() const { return rhs; }
+    bool contains(int value) const { return lhs.contains(value) || rhs.contains(value); }
+    size_t sizeBound() const { return ::sizeBound(lhs) + ::sizeBound(rhs); }
+
+    template <typename F>
+    void forEach(F f) const {
+        lhs.forEach(f);
+        rhs.forEach([&](int value) {
+            if (!lhs.contains(value)) f(value);
+        });
+    }
+};
+
+// The operand with the smaller size bound drives the pass, so in a chain of
+// intersections the smallest set is walked once and the rest are probed.
+template <typename L, typename R>
+class IntersectionExpr {
+private:
+    typename ExprOperand<L>::type lhs;
+    typename ExprOperand<R>::type rhs;
+
+public:
+    IntersectionExpr(typename ExprOperand<L>::type l, typename ExprOperand<R>::type r) : lhs(std::move(l)), rhs(std::move(r)) {}
+    const L& left() const { return lhs; }
+    const R& right() const { return rhs; }
+    bool contains(int value) const { return lhs.contains(value) && rhs.contains(value); }
+    size_t sizeBound() const { return std::min(::sizeBound(lhs), ::sizeBound(rhs)); }
+
+    template <typename F>
+    void forEach(F f) const {
+        if (::sizeBound(lhs) <= ::sizeBound(rhs)) {
+            lhs.forEach([&](int value) {
+                if (rhs.contains(value)) f(value);
+            });
+        } else {
+            rhs.forEach([&](int value) {
+                if (lhs.contains(value)) f(value);
+            });
+        }
+    }
+};
+
+template <typename T>
+struct IsSetOperand : std::integral_constant<bool, IsSetExpr<T>::value || std::is_same<T, Set>::value> {};
+
+template <typename L, typename R>
+struct EnableSetOperands : std::enable_if<IsSetOperand<L>::value && IsSetOperand<R>::value> {};
+
+template <typename L, typename R, typename = typename EnableSetOperands<L, R>::type>
+UnionExpr<L, R> operator+(const L& l, const R& r) {
+    return UnionExpr<L, R>(l, r);
+}
+
+template <typename L, typename R, typename = typename EnableSetOperands<L, R>::type>
+IntersectionExpr<L, R> operator*(const L& l, const R& r) {
+    return IntersectionExpr<L, R>(l, r);
+}
+
+// A temporary set next to an expression is moved into the tree.
+template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+UnionExpr<OwnedSet, E> operator+(Set&& l, const E& r) {
+    return UnionExpr<OwnedSet, E>(OwnedSet(std::move(l)), r);
+}
+
+template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+UnionExpr<E, OwnedSet> operator+(const E& l, Set&& r) {
+    return UnionExpr<E, OwnedSet>(l, OwnedSet(std::move(r)));
+}
+
+template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+IntersectionExpr<OwnedSet, E> operator*(Set&& l, const E& r) {
+    return IntersectionExpr<OwnedSet, E>(OwnedSet(std::move(l)), r);
+}
+
+template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+IntersectionExpr<E, OwnedSet> operator*(const E& l, Set&& r) {
+    return IntersectionExpr<E, OwnedSet>(l, OwnedSet(std::move(r)));
+}
+
+template <typename E, typename = typename std::enable_if<IsSetExpr<E>::value>::type>
+std::ostream& operator<<(std::ostream& out, const E& e) {
+    ValueWriter writer(out);
+    e.forEach([&writer](int value) { writer.write(value); });
+    writer.flush();
+    return out;
+}
+
+void Set::sortedElements(std::vector<int>& out, unsigned threads) const {
+    out.clear();
+    out.reserve(elements.size());
+    elements.forEach([&out](int value) { out.push_back(value); });
+    parallelSort(out, threads);
+}
+
+void Set::assignSorted(const std::vector<int>& values, unsigned threads) {
+    elements = HashTable();
+    if (threads > 1) {
+        elements.fillParallel(values.data(), values.size(), threads);
+    } else {
+        elements.insertBatch(values.data(), values.size());
+    }
+    if (filter.enabled()) rebuildFilter(filter.bitsPerValue());
+    if (sketch.enabled()) buildSketch(sketch, sketch.bins());
+}
+
+// Sized for twice the current elements, so a growing set rebuilds its
+// filter only each time it doubles. Rebuilding also drops the bits left
+// behind by removed values.
+void Set::rebuildFilter(unsigned bitsPerValue) {
+    filter.reset(elements.size() * 2, bitsPerValue);
+    elements.forEach([this](int value) { filter.insert(value); });
+}
+
+void Set::buildSketch(MinHashSketch& out, size_t bins) const {
+    out.reset(bins);
+    elements.forEach([&out](int value) { out.insert(value); });
+}
+
+void Set::noteInserted(const int* values, size_t n) {
+    if (sketch.enabled() && !sketch.isStale()) {
+        for (size_t i = 0; i < n; ++i) sketch.insert(values[i]);
+    }
+    if (!filter.enabled()) return;
+    for (size_t i = 0; i < n; ++i) filter.insert(values[i]);
+    if (filter.full()) rebuildFilter(filter.bitsPerValue());
+}
+
+void Set::enableFilter(unsigned bitsPerValue) {
+    rebuildFilter(std::max(1u, bitsPerValue));
+}
+
+void Set::enableSketch(size_t bins) {
+    buildSketch(sketch, bins);
+}
+
+MinHashSketch Set::similaritySketch() const {
+    if (!sketch.isStale()) return sketch;
+    MinHashSketch fresh;
+    buildSketch(fresh, sketch.bins());
+    return fresh;
+}
+
+// Values that pass the filter are gathered a block at a time, so the table
+// lookups for them are batched and prefetched as well.
+void Set::containsBatch(const int* values, size_t n, bool* out) const {
+    if (!filter.enabled()) {
+        elements.containsBatch(values, n, out);
+        return;
+    }
+    filter.mayContainBatch(values, n, out);
+    const size_t block = 256;
+    int candidates[block];
+    size_t positions[block];
+    bool found[block];
+    for (size_t begin = 0; begin < n; begin += block) {
+        size_t end = std::min(n, begin + block), m = 0;
+        for (size_t i = begin; i < end; ++i) {
+            if (out[i]) {
+                positions[m] = i;
+                candidates[m++] = values[i];
+            }
+        }
+        elements.containsBatch(candidates, m, found);
+        for (size_t k = 0; k < m; ++k) out[positions[k]] = found[k];
+    }
+}
+
+size_t Set::containsBatch(const int* values, size_t n, uint64_t* mask) const {
+    const size_t block = 1024;
+    bool found[block];
+    size_t hits = 0;
+    for (size_t begin = 0; begin < n; begin += block) {
+        size_t m = std::min(block, n - begin);
+        containsBatch(values + begin, m, found);
+        for (size_t w = 0; w * 64 < m; ++w) {
+            uint64_t word = 0;
+            for (size_t k = w * 64; k < std::min(m, w * 64 + 64); ++k) word |= uint64_t(found[k]) << (k % 64);
+            mask[(begin + w * 64) / 64] = word;
+            hits += __builtin_popcountll(word);
+        }
+    }
+    return hits;
+}
+
+// Bulk build: sort and dedup a copy of the input once, then fill the table
+// in a single pass.
+Set::Set(const int arr[], size_t size) {
+    if (size <= HashTable::INLINE_CAPACITY) {
+        elements.insertBatch(arr, size);
+        return;
+    }
+    std::vector<int> values(arr, arr + size);
+    parallelSort(values);
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    assignSorted(values, workerCount(values.size()));
+}
+
+// Parses straight off the stream buffer, which already reads the input in
+// blocks, instead of paying for a sentry and a locale lookup per value.
+// Values are inserted in batches. Like the in >> value loop this replaces,
+// it stops in front of the first token that is not an int and sets failbit.
+// Streams set to another base, to noskipws or to a locale other than "C"
+// keep that loop, as ValueWriter does on output.
+std::istream& operator>>(std::istream& in, Set& s) {
+    std::vector<int> batch;
+    auto insertBatch = [&] {
+        s.elements.insertBatch(batch.data(), batch.size());
+        s.noteInserted(batch.data(), batch.size());
+        batch.clear();
+    };
+    const std::ios_base::fmtflags flags = in.flags();
+    if ((flags & std::ios_base::basefield) != std::ios_base::dec || !(flags & std::ios_base::skipws) ||
+        in.getloc() != std::locale::classic()) {
+        int value;
+        while (in >> value) {
+            batch.push_back(value);
+            if (batch.size() == INPUT_BATCH) insertBatch();
+        }
+        insertBatch();
+        return in;
+    }
+    std::istream::sentry guard(in);
+    if (!guard) return in;
+    std::streambuf* buf = in.rdbuf();
+    const int eof = std::char_traits<char>::eof();
+    std::ios_base::iostate state = std::ios_base::goodbit;
+    batch.reserve(INPUT_BATCH);
+    int c = buf->sgetc();
+    while (true) {
+        while (c != eof && std::isspace(c)) c = buf->snextc();
+        if (c == eof) {
+            state = std::ios_base::eofbit | std::ios_base::failbit;
+            break;
+        }
+        bool negative = c == '-';
+        if (c == '-' || c == '+') c = buf->snextc();
+        if (c < '0' || c > '9') {
+            state = std::ios_base::failbit;
+            break;
+        }
+        uint64_t magnitude = 0;
+        do {
+            magnitude = std::min<uint64_t>(magnitude * 10 + (c - '0'), uint64_t(INT_MAX) + 2);
+            c = buf->snextc();
+        } while (c >= '0' && c <= '9');
+        if (magnitude > uint64_t(INT_MAX) + (negative ? 1 : 0)) {
+            state = std::ios_base::failbit;
+            break;
+        }
+        batch.push_back(static_cast<int>(negative ? -static_cast<int64_t>(magnitude) : magnitude));
+        if (batch.size() == INPUT_BATCH) insertBatch();
+    }
+    if (c == eof) state |= std::ios_base::eofbit;
+    insertBatch();
+    in.setstate(state);
+    return in;
+}
+
+std::ostream& operator<<(std::ostream& out, const Set& s) {
+    ValueWriter writer(out);
+    s.elements.forEach([&writer](int value) { writer.write(value); });
+    writer.flush();
+    return out;
+}
+
+Set::Set(Set&& other) noexcept
+    : elements(std::move(other.elements)),
+      filter(std::move(other.filter)),
+      sketch(std::move(other.sketch)) {
+    other.filter.clear();
+    other.sketch.clear();
+}
+
+// The larger table is copied whole and the smaller one inserted into it in
+// batches: O(N + M) with no sorting, and sets that fit in the inline
+// storage together never allocate.
+Set::Set(const UnionExpr<Set, Set>& e) {
+    const Set& small = e.left().size() <= e.right().size() ? e.left() : e.right();
+    const Set& large = &small == &e.left() ? e.right() : e.left();
+    elements = large.elements;
+    elements.reserve(large.size() + small.size());
+    small.forEachBlock([this](const int* values, size_t n) { elements.insertBatch(values, n); });
+}
+
+// The smaller operand is walked and probed against the larger one a block
+// at a time, so a filter on the larger set screens out the misses before
+// its table is touched. O(min(N, M)) lookups and no sorting.
+Set::Set(const IntersectionExpr<Set, Set>& e) {
+    const Set& small = e.left().size() <= e.right().size() ? e.left() : e.right();
+    const Set& large = &small == &e.left() ? e.right() : e.left();
+    small.forEachBlock([&](const int* values, size_t n) {
+        bool found[PROBE_BLOCK];
+        int common[PROBE_BLOCK];
+        size_t hits = 0;
+        large.containsBatch(values, n, found);
+        for (size_t i = 0; i < n; ++i) {
+            if (found[i]) common[hits++] = values[i];
+        }
+        elements.insertBatch(common, hits);
+    });
+}
+
+Set& Set::operator|=(const Set& other) {
+    if (this == &other) return *this;
+    elements.reserve(elements.size() + other.elements.size());
+    other.elements.forEach([&](int value) {
+        if (elements.insert(value)) noteInserted(&value, 1);
+    });
+    return *this;
+}
+
+// Drops every element the other set lacks straight out of the table. When
+// the other set is much smaller it is cheaper to build the intersection
+// from its side instead.
+Set& Set::operator&=(const Set& other) {
+    if (this == &other) return *this;
+    if (other.elements.size() * 4 < elements.size()) {
+        unsigned bits = filter.bitsPerValue();
+        size_t bins = sketch.bins();
+        *this = *this * other;
+        if (bits != 0) enableFilter(bits);
+        if (bins != 0) enableSketch(bins);
+        return *this;
+    }
+    std::vector<int> dropped;
+    elements.forEach([&](int value) {
+        if (!other.contains(value)) dropped.push_back(value);
+    });
+    for (int value : dropped) elements.remove(value);
+    if (filter.enabled() && dropped.size() > elements.size()) rebuildFilter(filter.bitsPerValue());
+    if (!dropped.empty()) sketch.markStale();
+    return *this;
+}
+
+Set Set::parallelUnion(const Set& other, unsigned threads) const {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> a, b, merged;
+    sortedElements(a, threads);
+    other.sortedElements(b, threads);
+    shardedMerge(a, b, threads, mergeUnion, merged);
+    Set result;
+    result.assignSorted(merged, threads);
+    return result;
+}
+
+Set Set::parallelIntersection(const Set& other, unsigned threads) const {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> a, b, common;
+    sortedElements(a, threads);
+    other.sortedElements(b, threads);
+    size_t (*kernel)(const int*, size_t, const int*, size_t, int*) = intersectSorted;
+    shardedMerge(a, b, threads, kernel, common);
+    Set result;
+    result.assignSorted(common, threads);
+    return result;
+}
+
+// k-way merge of the sorted copies through a min-heap of cursors. The top
+// cursor is advanced in place and sifted down, one pass per value instead
+// of a pop and a push. Equal heads surface one after another, so each
+// value is written once.
+Set Set::unionAll(const Set* const sets[], size_t count) {
+    struct Cursor {
+        const int* at;
+        const int* end;
+    };
+    std::vector<std::vector<int>> copies(count);
+    std::vector<Cursor> heap;
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<int>& values = copies[i];
+        sets[i]->sortedElements(values);
+        total += values.size();
+        if (!values.empty()) heap.push_back(Cursor{values.data(), values.data() + values.size()});
+    }
+    auto siftDown = [&heap](size_t i) {
+        Cursor moving = heap[i];
+        while (true) {
+            size_t child = 2 * i + 1;
+            if (child >= heap.size()) break;
+            if (child + 1 < heap.size() && *heap[child + 1].at < *heap[child].at) ++child;
+            if (*moving.at <= *heap[child].at) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = moving;
+    };
+    for (size_t i = heap.size(); i-- > 0;) siftDown(i);
+    std::vector<int> merged;
+    merged.reserve(total);
+    while (!heap.empty()) {
+        Cursor& top = heap[0];
+        if (merged.empty() || merged.back() != *top.at) merged.push_back(*top.at);
+        if (++top.at == top.end) {
+            top = heap.back();
+            heap.pop_back();
+            if (heap.empty()) break;
+        }
+        siftDown(0);
+    }
+    Set result;
+    result.assignSorted(merged, workerCount(merged.size()));
+    return result;
+}
+
+// Smallest set first: its values seed the candidates, and every other set,
+// in order of size, thins them out in place. No candidate list is ever
+// larger than the set it is checked against, so each one is looked up in
+// that set's table with the prefetching batch probe, which costs nothing
+// per element of the larger set. The loop stops as soon as nothing
+// survives. The candidates are never sorted, and they and their hit mask
+// are all it allocates.
+Set Set::intersectAll(const Set* const sets[], size_t count) {
+    Set result;
+    if (count == 0) return result;
+    std::vector<const Set*> order(sets, sets + count);
+    std::sort(order.begin(), order.end(), [](const Set* a, const Set* b) { return a->size() < b->size(); });
+    std::vector<int> common;
+    common.reserve(order[0]->size());
+    order[0]->elements.forEach([&common](int value) { common.push_back(value); });
+    std::vector<uint64_t> found((common.size() + 63) / 64);
+    for (size_t i = 1; i < count && !common.empty(); ++i) {
+        order[i]->containsBatch(common.data(), common.size(), found.data());
+        size_t kept = 0;
+        for (size_t j = 0; j < common.size(); ++j) {
+            if (found[j / 64] >> (j % 64) & 1) common[kept++] = common[j];
+        }
+        common.resize(kept);
+    }
+    unsigned threads = workerCount(common.size());
+    if (threads > 1) {
+        result.elements.fillParallel(common.data(), common.size(), threads);
+    } else {
+        result.elements.insertBatch(common.data(), common.size());
+    }
+    return result;
+}
+
+// The probes go through the batch lookup a stack buffer at a time.
+size_t Set::intersectionSize(const Set& other) const {
+    if (this == &other) return size();
+    const Set& small = size() <= other.size() ? *this : other;
+    const Set& large = &small == this ? other : *this;
+    size_t common = 0;
+    small.forEachBlock([&](const int* values, size_t n) {
+        bool found[PROBE_BLOCK];
+        large.containsBatch(values, n, found);
+        for (size_t i = 0; i < n; ++i) common += found[i];
+    });
+    return common;
+}
+
+size_t Set::unionSize(const Set& other) const {
+    return size() + other.size() - intersectionSize(other);
+}
+
+double Set::jaccard(const Set& other) const {
+    size_t common = intersectionSize(other), all = size() + other.size() - common;
+    return all ? double(common) / all : 1.0;
+}
+
+double Set::approximateJaccard(const Set& other) const {
+    if (!sketch.enabled() || sketch.bins() != other.sketch.bins()) return jaccard(other);
+    if (!sketch.isStale() && !other.sketch.isStale()) return sketch.similarity(other.sketch);
+    return similaritySketch().similarity(other.similaritySketch());
+}
+
+Set& Set::operator+=(int value) {
+    if (elements.insert(value)) noteInserted(&value, 1);
+    return *this;
+}
+
+Set& Set::operator-=(int value) {
+    if (elements.remove(value)) sketch.markStale();
+    return *this;
+}
+
+Set& Set::operator=(const Set& other) {
+    if (this != &other) {
+        elements = other.elements;
+        filter = other.filter;
+        sketch = other.sketch;
+    }
+    return *this;
+}
+
+Set& Set::operator=(Set&& other) noexcept {
+    if (this != &other) {
+        elements = std::move(other.elements);
+        filter = std::move(other.filter);
+        other.filter.clear();
+        sketch = std::move(other.sketch);
+        other.sketch.clear();
+    }
+    return *this;
+}
+
+// Roaring-style compressed bitmap over ints. Values are split into chunks
+// of 65536 by their high 16 bits, and every chunk keeps whichever container
+// is smallest for its contents: a sorted array of low halves, a 1024-word
+// bitset, or a list of runs.
+class CompressedBitmap {
+private:
+    enum ContainerKind { ARRAY, BITSET, RUN };
+    struct Container {
+        ContainerKind kind;
+        uint32_t cardinality;
+        // ARRAY: sorted low halves. RUN: (start, length - 1) pairs.
+        std::vector<uint16_t> values;
+        // BITSET: CHUNK_WORDS words.
+        std::vector<uint64_t> words;
+    };
+    static const size_t CHUNK_WORDS = 1024;
+    static const uint32_t ARRAY_MAX = 4096;
+
+    std::vector<uint16_t> keys;
+    std::vector<Container> containers;
+
+    // Flipping the sign bit keeps signed order when values are split.
+    static uint32_t toUnsigned(int value) { return static_cast<uint32_t>(value) ^ 0x80000000u; }
+    static int toSigned(uint32_t value) { return static_cast<int>(value ^ 0x80000000u); }
+
+    static bool containerContains(const Container& c, uint16_t low);
+    static void fillWords(const Container& c, uint64_t* words);
+    static void collect(const Container& c, std::vector<uint16_t>& lows);
+    static Container fromWords(const uint64_t* words);
+    static Container fromSorted(const std::vector<uint16_t>& lows);
+    static void insertIntoRuns(Container& c, uint16_t low);
+    void append(uint16_t key, const Container& c);
+
+public:
+    CompressedBitmap() {}
+    CompressedBitmap(const int arr[], size_t size);
+    bool contains(int value) const;
+    size_t size() const;
+    CompressedBitmap& operator+=(int value);
+    CompressedBitmap operator+(const CompressedBitmap& other) const;
+    CompressedBitmap operator*(const CompressedBitmap& other) const;
+    friend std::ostream& operator<<(std::ostream& out, const CompressedBitmap& b);
+};
+
+bool CompressedBitmap::containerContains(const Container& c, uint16_t low) {
+    if (c.kind == BITSET) {
+        return (c.words[low >> 6] >> (low & 63)) & 1;
+    }
+    if (c.kind == ARRAY) {
+        return std::binary_search(c.values.begin(), c.values.end(), low);
+    }
+    size_t lo = 0, hi = c.values.size() / 2;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c.values[mid * 2] <= low) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return false;
+    uint32_t start = c.values[(lo - 1) * 2];
+    return low <= start + c.values[(lo - 1) * 2 + 1];
+}
+
+void CompressedBitmap::fillWords(const Container& c, uint64_t* words) {
+    if (c.kind == BITSET) {
+        std::copy(c.words.begin(), c.words.end(), words);
+        return;
+    }
+    std::fill(words, words + CHUNK_WORDS, 0);
+    if (c.kind == ARRAY) {
+        for (uint16_t low : c.values) words[low >> 6] |= uint64_t(1) << (low & 63);
+        return;
+    }
+    for (size_t r = 0; r < c.values.size(); r += 2) {
+        uint32_t end = uint32_t(c.values[r]) + c.values[r + 1];
+        for (uint32_t low = c.values[r]; low <= end; ++low) {
+            words[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+    }
+}
+
+void CompressedBitmap::collect(const Container& c, std::vector<uint16_t>& lows) {
+    lows.clear();
+    if (c.kind == ARRAY) {
+        lows = c.values;
+    } else if (c.kind == RUN) {
+        for (size_t r = 0; r < c.values.size(); r += 2) {
+            uint32_t end = uint32_t(c.values[r]) + c.values[r + 1];
+            for (uint32_t low = c.values[r]; low <= end; ++low) lows.push_back(static_cast<uint16_t>(low));
+        }
+    } else {
+        for (size_t w = 0; w < CHUNK_WORDS; ++w) {
+            uint64_t bits = c.words[w];
+            while (bits) {
+                lows.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+}
+
+// Picks the smallest container for a chunk given as a full bitset:
+// 2 bytes per value for an array, 8 KB for a bitset, 4 bytes per run.
+CompressedBitmap::Container CompressedBitmap::fromWords(const uint64_t* words) {
+    uint32_t cardinality = 0, runs = 0;
+    uint64_t carry = 0;
+    for (size_t w = 0; w < CHUNK_WORDS; ++w) {
+        cardinality += __builtin_popcountll(words[w]);
+        runs += __builtin_popcountll(words[w] & ~((words[w] << 1) | carry));
+        carry = words[w] >> 63;
+    }
+    Container c;
+    c.cardinality = cardinality;
+    size_t bitsetBytes = CHUNK_WORDS * 8;
+    if (runs * 4 < bitsetBytes && runs * 4 <= cardinality * 2) {
+        c.kind = RUN;
+        int start = -1;
+        for (uint32_t low = 0; low <= 65536; ++low) {
+            bool set = low < 65536 && ((words[low >> 6] >> (low & 63)) & 1);
+            if (set && start < 0) {
+                start = static_cast<int>(low);
+            } else if (!set && start >= 0) {
+                c.values.push_back(static_cast<uint16_t>(start));
+                c.values.push_back(static_cast<uint16_t>(low - 1 - start));
+                start = -1;
+            }
+        }
+    } else if (cardinality <= ARRAY_MAX) {
+        c.kind = ARRAY;
+        c.values.reserve(cardinality);
+        for (size_t w = 0; w < CHUNK_WORDS; ++w) {
+            uint64_t bits = words[w];
+            while (bits) {
+                c.values.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+    } else {
+        c.kind = BITSET;
+        c.words.assign(words, words + CHUNK_WORDS);
+    }
+    return c;
+}
+
+CompressedBitmap::Container CompressedBitmap::fromSorted(const std::vector<uint16_t>& lows) {
+    if (lows.size() > ARRAY_MAX) {
+        std::vector<uint64_t> words(CHUNK_WORDS, 0);
+        for (uint16_t low : lows) words[low >> 6] |= uint64_t(1) << (low & 63);
+        return fromWords(words.data());
+    }
+    size_t runs = 0;
+    for (size_t i = 0; i < lows.size(); ++i) {
+        if (i == 0 || lows[i] != lows[i - 1] + 1) ++runs;
+    }
+    Container c;
+    c.cardinality = static_cast<uint32_t>(lows.size());
+    if (runs * 4 < lows.size() * 2) {
+        c.kind = RUN;
+        for (size_t i = 0; i < lows.size();) {
+            size_t j = i;
+            while (j + 1 < lows.size() && lows[j + 1] == lows[j] + 1) ++j;
+            c.values.push_back(lows[i]);
+            c.values.push_back(static_cast<uint16_t>(j - i));
+            i = j + 1;
+        }
+    } else {
+        c.kind = ARRAY;
+        c.values = lows;
+    }
+    return c;
+}
+
+void CompressedBitmap::append(uint16_t key, const Container& c) {
+    if (c.cardinality == 0) return;
+    keys.push_back(key);
+    containers.push_back(c);
+}
+
+CompressedBitmap::CompressedBitmap(const int arr[], size_t size) {
+    std::vector<uint32_t> values(size);
+    for (size_t i = 0; i < size; ++i) values[i] = toUnsigned(arr[i]);
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    std::vector<uint16_t> lows;
+    for (size_t i = 0; i < values.size();) {
+        uint16_t key = static_cast<uint16_t>(values[i] >> 16);
+        lows.clear();
+        while (i < values.size() && (values[i] >> 16) == key) {
+            lows.push_back(static_cast<uint16_t>(values[i] & 0xFFFF));
+            ++i;
+        }
+        append(key, fromSorted(lows));
+    }
+}
+
+bool CompressedBitmap::contains(int value) const {
+    uint32_t u = toUnsigned(value);
+    uint16_t key = static_cast<uint16_t>(u >> 16);
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    if (it == keys.end() || *it != key) return false;
+    return containerContains(containers[it - keys.begin()], static_cast<uint16_t>(u & 0xFFFF));
+}
+
+size_t CompressedBitmap::size() const {
+    size_t total = 0;
+    for (const Container& c : containers) total += c.cardinality;
+    return total;
+}
+
+CompressedBitmap& CompressedBitmap::operator+=(int value) {
+    uint32_t u = toUnsigned(value);
+    uint16_t key = static_cast<uint16_t>(u >> 16);
+    uint16_t low = static_cast<uint16_t>(u & 0xFFFF);
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    size_t index = it - keys.begin();
+    if (it == keys.end() || *it != key) {
+        Container c;
+        c.kind = ARRAY;
+        c.cardinality = 1;
+        c.values.push_back(low);
+        keys.insert(it, key);
+        containers.insert(containers.begin() + index, c);
+        return *this;
+    }
+    Container& c = containers[index];
+    if (containerContains(c, low)) return *this;
+    if (c.kind == BITSET) {
+        c.words[low >> 6] |= uint64_t(1) << (low & 63);
+        ++c.cardinality;
+    } else if (c.kind == ARRAY && c.cardinality < ARRAY_MAX) {
+        c.values.insert(std::lower_bound(c.values.begin(), c.values.end(), low), low);
+        ++c.cardinality;
+    } else if (c.kind == ARRAY) {
+        // A full array turns into a bitset, which has room for the rest.
+        c.words.assign(CHUNK_WORDS, 0);
+        for (uint16_t v : c.values) c.words[v >> 6] |= uint64_t(1) << (v & 63);
+        c.words[low >> 6] |= uint64_t(1) << (low & 63);
+        std::vector<uint16_t>().swap(c.values);
+        c.kind = BITSET;
+        ++c.cardinality;
+    } else {
+        insertIntoRuns(c, low);
+    }
+    return *this;
+}
+
+// Grows the run ending just below low or starting just above it, joining
+// the two when low closes the gap between them, and otherwise adds a run
+// of one. Past the point where runs take more room than a bitset the
+// chunk becomes one.
+void CompressedBitmap::insertIntoRuns(Container& c, uint16_t low) {
+    size_t runs = c.values.size() / 2, lo = 0, hi = runs;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c.values[mid * 2] <= low) lo = mid + 1;
+        else hi = mid;
+    }
+    // lo is the first run starting above low.
+    bool extendsLeft = lo > 0 && uint32_t(c.values[(lo - 1) * 2]) + c.values[(lo - 1) * 2 + 1] + 1 == low;
+    bool extendsRight = lo < runs && uint32_t(low) + 1 == c.values[lo * 2];
+    if (extendsLeft && extendsRight) {
+        c.values[(lo - 1) * 2 + 1] += c.values[lo * 2 + 1] + 2;
+        c.values.erase(c.values.begin() + lo * 2, c.values.begin() + lo * 2 + 2);
+    } else if (extendsLeft) {
+        ++c.values[(lo - 1) * 2 + 1];
+    } else if (extendsRight) {
+        --c.values[lo * 2];
+        ++c.values[lo * 2 + 1];
+    } else {
+        uint16_t run[2] = {low, 0};
+        c.values.insert(c.values.begin() + lo * 2, run, run + 2);
+    }
+    ++c.cardinality;
+    if (c.values.size() * 2 > CHUNK_WORDS * 8) {
+        std::vector<uint64_t> words(CHUNK_WORDS);
+        fillWords(c, words.data());
+        c.words.swap(words);
+        std::vector<uint16_t>().swap(c.values);
+        c.kind = BITSET;
+    }
+}
+
+CompressedBitmap CompressedBitmap::operator+(const CompressedBitmap& other) const {
+    CompressedBitmap result;
+    std::vector<uint64_t> a(CHUNK_WORDS), b(CHUNK_WORDS);
+    std::vector<uint16_t> merged;
+    size_t i = 0, j = 0;
+    while (i < keys.size() || j < other.keys.size()) {
+        if (j == other.keys.size() || (i < keys.size() && keys[i] < other.keys[j])) {
+            result.append(keys[i], containers[i]);
+            ++i;
+        } else if (i == keys.size() || other.keys[j] < keys[i]) {
+            result.append(other.keys[j], other.containers[j]);
+            ++j;
+        } else {
+            const Container& x = containers[i];
+            const Container& y = other.containers[j];
+            if (x.kind == ARRAY && y.kind == ARRAY) {
+                merged.clear();
+                std::set_union(x.values.begin(), x.values.end(), y.values.begin(), y.values.end(),
+                               std::back_inserter(merged));
+                result.append(keys[i], fromSorted(merged));
+            } else {
+                fillWords(x, a.data());
+                fillWords(y, b.data());
+                for (size_t w = 0; w < CHUNK_WORDS; ++w) a[w] |= b[w];
+                result.append(keys[i], fromWords(a.data()));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+CompressedBitmap CompressedBitmap::operator*(const CompressedBitmap& other) const {
+    CompressedBitmap result;
+    std::vector<uint64_t> a(CHUNK_WORDS), b(CHUNK_WORDS);
+    std::vector<uint16_t> common;
+    size_t i = 0, j = 0;
+    while (i < keys.size() && j < other.keys.size()) {
+        if (keys[i] < other.keys[j]) {
+            ++i;
+        } else if (other.keys[j] < keys[i]) {
+            ++j;
+        } else {
+            const Container& x = containers[i];
+            const Container& y = other.containers[j];
+            if (x.kind == ARRAY || y.kind == ARRAY) {
+                const Container& arr = x.kind == ARRAY ? x : y;
+                const Container& rest = x.kind == ARRAY ? y : x;
+                common.clear();
+                for (uint16_t low : arr.values) {
+                    if (containerContains(rest, low)) common.push_back(low);
+                }
+                result.append(keys[i], fromSorted(common));
+            } else {
+                fillWords(x, a.data());
+                fillWords(y, b.data());
+                for (size_t w = 0; w < CHUNK_WORDS; ++w) a[w] &= b[w];
+                result.append(keys[i], fromWords(a.data()));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+std::ostream& operator<<(std::ostream& out, const CompressedBitmap& b) {
+    std::vector<uint16_t> lows;
+    ValueWriter writer(out);
+    for (size_t i = 0; i < b.keys.size(); ++i) {
+        CompressedBitmap::collect(b.containers[i], lows);
+        uint32_t high = uint32_t(b.keys[i]) << 16;
+        for (uint16_t low : lows) writer.write(CompressedBitmap::toSigned(high | low));
+    }
+    writer.flush();
+    return out;
+}
+
+// Sorted, disjoint spans [lo, hi]. Spans that overlap or touch are merged,
+// so a contiguous range costs one span however long it is. + and * merge
+// the two span lists directly, and << expands the spans as it writes.
+class IntervalSet {
+private:
+    struct Span {
+        int lo;
+        int hi;
+    };
+    std::vector<Span> spans;
+    size_t count;
+
+    static size_t length(const Span& s) { return static_cast<size_t>(int64_t(s.hi) - s.lo + 1); }
+    // Index of the first span starting above value.
+    size_t spanAfter(int value) const;
+    // Appends a span that starts no earlier than the last one.
+    void append(int lo, int hi);
+
+public:
+    IntervalSet() : count(0) {}
+    IntervalSet(const int arr[], size_t size);
+    bool contains(int value) const;
+    size_t size() const { return count; }
+    size_t spanCount() const { return spans.size(); }
+    IntervalSet& addRange(int lo, int hi);
+    IntervalSet& operator+=(int value) { return addRange(value, value); }
+    IntervalSet& operator-=(int value);
+    IntervalSet operator+(const IntervalSet& other) const;
+    IntervalSet operator*(const IntervalSet& other) const;
+
+    template <typename F>
+    void forEach(F f) const {
+        for (const Span& s : spans) {
+            for (int64_t value = s.lo; value <= s.hi; ++value) f(static_cast<int>(value));
+        }
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const IntervalSet& s);
+};
+
+size_t IntervalSet::spanAfter(int value) const {
+    return std::upper_bound(spans.begin(), spans.end(), value, [](int v, const Span& s) { return v < s.lo; }) -
+           spans.begin();
+}
+
+void IntervalSet::append(int lo, int hi) {
+    if (!spans.empty() && int64_t(lo) <= int64_t(spans.back().hi) + 1) {
+        if (hi > spans.back().hi) {
+            count += static_cast<size_t>(int64_t(hi) - spans.back().hi);
+            spans.back().hi = hi;
+        }
+        return;
+    }
+    spans.push_back(Span{lo, hi});
+    count += length(spans.back());
+}
+
+IntervalSet::IntervalSet(const int arr[], size_t size) : count(0) {
+    std::vector<int> values(arr, arr + size);
+    parallelSort(values);
+    for (int value : values) append(value, value);
+}
+
+bool IntervalSet::contains(int value) const {
+    size_t i = spanAfter(value);
+    return i > 0 && spans[i - 1].hi >= value;
+}
+
+IntervalSet& IntervalSet::addRange(int lo, int hi) {
+    if (lo > hi) return *this;
+    size_t first = std::lower_bound(spans.begin(), spans.end(), lo,
+                                    [](const Span& s, int v) { return int64_t(s.hi) + 1 < v; }) -
+                   spans.begin();
+    size_t last = first;
+    while (last < spans.size() && int64_t(spans[last].lo) - 1 <= hi) {
+        lo = std::min(lo, spans[last].lo);
+        hi = std::max(hi, spans[last].hi);
+        count -= length(spans[last]);
+        ++last;
+    }
+    if (last == first) {
+        spans.insert(spans.begin() + first, Span{lo, hi});
+    } else {
+        spans[first] = Span{lo, hi};
+        spans.erase(spans.begin() + first + 1, spans.begin() + last);
+    }
+    count += length(spans[first]);
+    return *this;
+}
+
+IntervalSet& IntervalSet::operator-=(int value) {
+    size_t i = spanAfter(value);
+    if (i == 0 || spans[i - 1].hi < value) return *this;
+    Span& s = spans[--i];
+    --count;
+    if (s.lo == s.hi) {
+        spans.erase(spans.begin() + i);
+    } else if (value == s.lo) {
+        ++s.lo;
+    } else if (value == s.hi) {
+        --s.hi;
+    } else {
+        Span upper{value + 1, s.hi};
+        s.hi = value - 1;
+        spans.insert(spans.begin() + i + 1, upper);
+    }
+    return *this;
+}
+
+IntervalSet IntervalSet::operator+(const IntervalSet& other) const {
+    IntervalSet result;
+    result.spans.reserve(spans.size() + other.spans.size());
+    size_t i = 0, j = 0;
+    while (i < spans.size() || j < other.spans.size()) {
+        bool mine = j == other.spans.size() || (i < spans.size() && spans[i].lo <= other.spans[j].lo);
+        const Span& s = mine ? spans[i++] : other.spans[j++];
+        result.append(s.lo, s.hi);
+    }
+    return result;
+}
+
+IntervalSet IntervalSet::operator*(const IntervalSet& other) const {
+    IntervalSet result;
+    size_t i = 0, j = 0;
+    while (i < spans.size() && j < other.spans.size()) {
+        int lo = std::max(spans[i].lo, other.spans[j].lo);
+        int hi = std::min(spans[i].hi, other.spans[j].hi);
+        if (lo <= hi) result.append(lo, hi);
+        if (spans[i].hi < other.spans[j].hi) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return result;
+}
+
+std::ostream& operator<<(std::ostream& out, const IntervalSet& s) {
+    ValueWriter writer(out);
+    s.forEach([&writer](int value) { writer.write(value); });
+    writer.flush();
+    return out;
+}
+
+// Immutable set stored as a hash array mapped trie. Values are placed by a
+// 32-bit multiplicative hash, which is a bijection on ints, five bits per
+// level from the top, so the trie is at most seven levels deep and two
+// values always part by the last one. A node keeps its values and
+// children in two small arrays indexed by popcount over a 32-bit map.
+//
+// Nodes are never changed after they are built. An update copies only the
+// nodes on the path to the changed slot and shares the rest, so copying a
+// PersistentSet is O(1) and every copy is a snapshot. Nodes are owned
+// through shared_ptr, whose count is atomic, so readers on other threads
+// can keep using their own copies while the writer moves on. Handing one
+// PersistentSet object to several threads while it is being assigned is
+// still a data race; pass each reader its own copy.
+class PersistentSet {
+private:
+    struct Node {
+        uint32_t valueMap;
+        uint32_t childMap;
+        std::vector<int> values;
+        std::vector<std::shared_ptr<const Node>> children;
+        Node() : valueMap(0), childMap(0) {}
+    };
+    typedef std::shared_ptr<const Node> NodePtr;
+    static const int LEVELS = 7;
+
+    NodePtr root;
+    size_t count;
+
+    static uint32_t hash(int value) { return static_cast<uint32_t>(value) * 0x9E3779B9u; }
+    // The hash is read as a 35-bit number so the seven levels get five
+    // bits each.
+    static uint32_t digit(uint32_t h, int level) {
+        return static_cast<uint32_t>((uint64_t(h) << 3) >> (30 - 5 * level)) & 31;
+    }
+    static size_t rank(uint32_t map, uint32_t bit) { return __builtin_popcount(map & (bit - 1)); }
+    static NodePtr pair(int a, int b, int level);
+    static NodePtr build(const std::pair<uint32_t, int>* first, const std::pair<uint32_t, int>* last, int level);
+    static NodePtr insert(const NodePtr& node, int value, int level, bool& added);
+    static NodePtr erase(const NodePtr& node, int value, int level, bool& removed);
+    template <typename F>
+    static void forEach(const Node& node, F& f);
+
+public:
+    PersistentSet() : root(std::make_shared<const Node>()), count(0) {}
+    PersistentSet(const int arr[], size_t size);
+    bool contains(int value) const;
+    size_t size() const { return count; }
+    // Return the updated set and leave this one as it was.
+    PersistentSet with(int value) const;
+    PersistentSet without(int value) const;
+    PersistentSet& operator+=(int value);
+    PersistentSet& operator-=(int value);
+
+    template <typename F>
+    void forEach(F f) const {
+        forEach(*root, f);
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const PersistentSet& s);
+};
+
+PersistentSet::NodePtr PersistentSet::pair(int a, int b, int level) {
+    std::shared_ptr<Node> node = std::make_shared<Node>();
+    uint32_t da = digit(hash(a), level), db = digit(hash(b), level);
+    if (da == db) {
+        node->childMap = 1u << da;
+        node->children.push_back(pair(a, b, level + 1));
+    } else {
+        node->valueMap = (1u << da) | (1u << db);
+        node->values.push_back(da < db ? a : b);
+        node->values.push_back(da < db ? b : a);
+    }
+    return node;
+}
+
+// Builds a subtree from values sorted by hash. Sorting by hash keeps every
+// subtree's values contiguous, since digits are taken from the top.
+PersistentSet::NodePtr PersistentSet::build(const std::pair<uint32_t, int>* first,
+                                            const std::pair<uint32_t, int>* last, int level) {
+    std::shared_ptr<Node> node = std::make_shared<Node>();
+    while (first != last) {
+        uint32_t d = digit(first->first, level);
+        const std::pair<uint32_t, int>* end = first + 1;
+        while (end != last && digit(end->first, level) == d) ++end;
+        if (end - first == 1) {
+            node->valueMap |= 1u << d;
+            node->values.push_back(first->second);
+        } else {
+            node->childMap |= 1u << d;
+            node->children.push_back(build(first, end, level + 1));
+        }
+        first = end;
+    }
+    return node;
+}
+
+PersistentSet::PersistentSet(const int arr[], size_t size) {
+    std::vector<std::pair<uint32_t, int>> hashed(size);
+    for (size_t i = 0; i < size; ++i) hashed[i] = std::make_pair(hash(arr[i]), arr[i]);
+    std::sort(hashed.begin(), hashed.end());
+    hashed.erase(std::unique(hashed.begin(), hashed.end()), hashed.end());
+    count = hashed.size();
+    root = build(hashed.data(), hashed.data() + hashed.size(), 0);
+}
+
+bool PersistentSet::contains(int value) const {
+    uint32_t h = hash(value);
+    const Node* node = root.get();
+    for (int level = 0; level < LEVELS; ++level) {
+        uint32_t bit = 1u << digit(h, level);
+        if (node->valueMap & bit) return node->values[rank(node->valueMap, bit)] == value;
+        if (!(node->childMap & bit)) return false;
+        node = node->children[rank(node->childMap, bit)].get();
+    }
+    return false;
+}
+
+PersistentSet::NodePtr PersistentSet::insert(const NodePtr& node, int value, int level, bool& added) {
+    uint32_t bit = 1u << digit(hash(value), level);
+    if (node->childMap & bit) {
+        size_t at = rank(node->childMap, bit);
+        NodePtr child = insert(node->children[at], value, level + 1, added);
+        if (!added) return node;
+        std::shared_ptr<Node> copy = std::make_shared<Node>(*node);
+        copy->children[at] = child;
+        return copy;
+    }
+    size_t at = rank(node->valueMap, bit);
+    if ((node->valueMap & bit) && node->values[at] == value) return node;
+    std::shared_ptr<Node> copy = std::make_shared<Node>(*node);
+    if (node->valueMap & bit) {
+        int existing = node->values[at];
+        copy->valueMap &= ~bit;
+        copy->values.erase(copy->values.begin() + at);
+        copy->childMap |= bit;
+        copy->children.insert(copy->children.begin() + rank(node->childMap, bit), pair(existing, value, level + 1));
+    } else {
+        copy->valueMap |= bit;
+        copy->values.insert(copy->values.begin() + at, value);
+    }
+    added = true;
+    return copy;
+}
+
+// A child left holding a single value is folded back into its parent, so
+// the trie has the same shape as if the value had never been there.
+PersistentSet::NodePtr PersistentSet::erase(const NodePtr& node, int value, int level, bool& removed) {
+    uint32_t bit = 1u << digit(hash(value), level);
+    std::shared_ptr<Node> copy;
+    if (node->valueMap & bit) {
+        size_t at = rank(node->valueMap, bit);
+        if (node->values[at] != value) return node;
+        copy = std::make_shared<Node>(*node);
+        copy->valueMap &= ~bit;
+        copy->values.erase(copy->values.begin() + at);
+    } else if (node->childMap & bit) {
+        size_t at = rank(node->childMap, bit);
+        NodePtr child = erase(node->children[at], value, level + 1, removed);
+        if (!removed) return node;
+        copy = std::make_shared<Node>(*node);
+        if (child->childMap == 0 && child->values.size() == 1) {
+            copy->childMap &= ~bit;
+            copy->children.erase(copy->children.begin() + at);
+            copy->valueMap |= bit;
+            copy->values.insert(copy->values.begin() + rank(copy->valueMap, bit), child->values[0]);
+        } else {
+            copy->children[at] = child;
+        }
+    } else {
+        return node;
+    }
+    removed = true;
+    return copy;
+}
+
+PersistentSet PersistentSet::with(int value) const {
+    PersistentSet result(*this);
+    result += value;
+    return result;
+}
+
+PersistentSet PersistentSet::without(int value) const {
+    PersistentSet result(*this);
+    result -= value;
+    return result;
+}
+
+PersistentSet& PersistentSet::operator+=(int value) {
+    bool added = false;
+    NodePtr updated = insert(root, value, 0, added);
+    if (added) {
+        root = updated;
+        ++count;
+    }
+    return *this;
+}
+
+PersistentSet& PersistentSet::operator-=(int value) {
+    bool removed = false;
+    NodePtr updated = erase(root, value, 0, removed);
+    if (removed) {
+        root = updated;
+        --count;
+    }
+    return *this;
+}
+
+template <typename F>
+void PersistentSet::forEach(const Node& node, F& f) {
+    for (int value : node.values) f(value);
+    for (const NodePtr& child : node.children) forEach(*child, f);
+}
+
+std::ostream& operator<<(std::ostream& out, const PersistentSet& s) {
+    ValueWriter writer(out);
+    s.forEach([&writer](int value) { writer.write(value); });
+    writer.flush();
+    return out;
+}
+
+// On-disk set format, version 1: a SetFileHeader followed by count values
+// in ascending order, each valueWidth bytes (4 or 8) in host byte order.
+// The header fields are fixed-width, so a file written on a machine of the
+// other endianness fails the version check instead of loading garbage.
+struct SetFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t valueWidth;
+    uint8_t flags;
+    uint64_t count;
+    uint64_t checksum;
+};
+
+const char SET_FILE_MAGIC[4] = {'S', 'E', 'T', 'B'};
+const uint16_t SET_FILE_VERSION = 1;
+const uint8_t SET_FILE_HAS_CHECKSUM = 1;
+
+// FNV-1a over 64-bit words, with the tail bytes folded in one at a time.
+uint64_t payloadChecksum(const unsigned char* data, size_t length) {
+    const uint64_t prime = 0x100000001B3ull;
+    uint64_t hash = 0xCBF29CE484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < length; ++i) hash = (hash ^ data[i]) * prime;
+    return hash;
+}
+
+// Read-only view of a set file. On POSIX systems the file is mmap'ed, so
+// opening costs the same for any size, and contains and the intersection
+// queries run straight on the mapped pages. Elsewhere the file is read into
+// memory once.
+class MappedSet {
+private:
+    const unsigned char* base;
+    size_t length;
+    SetFileHeader header;
+    std::vector<unsigned char> buffer;
+
+    const unsigned char* payload() const { return base + sizeof(SetFileHeader); }
+    int64_t valueAt(size_t i) const;
+
+public:
+    MappedSet() : base(nullptr), length(0) {}
+    ~MappedSet() { close(); }
+    MappedSet(const MappedSet&) = delete;
+    MappedSet& operator=(const MappedSet&) = delete;
+    // Checking the checksum reads every page, so it is off by default. The
+    // order of the values is never checked, for the same reason: a payload
+    // that is not strictly ascending gives wrong answers, but results are
+    // still sorted and distinct and nothing writes out of bounds.
+    bool open(const char* path, bool verifyChecksum = false);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return isOpen() ? static_cast<size_t>(header.count) : 0; }
+    bool contains(int64_t value) const;
+    size_t intersectionSize(const Set& other) const;
+    Set intersection(const Set& other) const;
+    Set toSet() const;
+    friend std::ostream& operator<<(std::ostream& out, const MappedSet& s);
+};
+
+int64_t MappedSet::valueAt(size_t i) const {
+    if (header.valueWidth == 4) {
+        int32_t value;
+        std::memcpy(&value, payload() + i * 4, 4);
+        return value;
+    }
+    int64_t value;
+    std::memcpy(&value, payload() + i * 8, 8);
+    return value;
+}
+
+bool MappedSet::open(const char* path, bool verifyChecksum) {
+    close();
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(SetFileHeader))) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    base = static_cast<const unsigned char*>(mapped);
+    length = static_cast<size_t>(info.st_size);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (buffer.size() < sizeof(SetFileHeader)) return false;
+    base = buffer.data();
+    length = buffer.size();
+#endif
+    std::memcpy(&header, base, sizeof(SetFileHeader));
+    bool valid = std::memcmp(header.magic, SET_FILE_MAGIC, 4) == 0 && header.version == SET_FILE_VERSION &&
+                 (header.valueWidth == 4 || header.valueWidth == 8) &&
+                 header.count == (length - sizeof(SetFileHeader)) / header.valueWidth &&
+                 (length - sizeof(SetFileHeader)) % header.valueWidth == 0;
+    if (valid && verifyChecksum && (header.flags & SET_FILE_HAS_CHECKSUM)) {
+        valid = payloadChecksum(payload(), length - sizeof(SetFileHeader)) == header.checksum;
+    }
+    if (!valid) close();
+    return valid;
+}
+
+void MappedSet::close() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (base != nullptr) munmap(const_cast<unsigned char*>(base), length);
+#endif
+    buffer.clear();
+    base = nullptr;
+    length = 0;
+}
+
+bool MappedSet::contains(int64_t value) const {
+    size_t lo = 0, hi = size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (valueAt(mid) < value) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < size() && valueAt(lo) == value;
+}
+
+size_t MappedSet::intersectionSize(const Set& other) const {
+    std::vector<int> b;
+    other.sortedElements(b);
+    if (header.valueWidth == 4) {
+        return intersectSorted(reinterpret_cast<const int*>(payload()), size(), b.data(), b.size(), nullptr);
+    }
+    size_t count = 0;
+    for (int value : b) count += contains(value);
+    return count;
+}
+
+// Sorts and dedups values unless they already ascend strictly, which is
+// one pass for the output of a well-formed file.
+void makeStrictlyAscending(std::vector<int>& values) {
+    if (std::adjacent_find(values.begin(), values.end(), [](int a, int b) { return a >= b; }) == values.end()) return;
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+// The kernels write at most one value per element of a strictly ascending
+// input, but a block kernel fed repeats writes a whole block per step, so
+// the buffer is sized for both inputs together.
+Set MappedSet::intersection(const Set& other) const {
+    std::vector<int> b;
+    other.sortedElements(b);
+    std::vector<int> common(size() + b.size() + 8);
+    if (header.valueWidth == 4) {
+        common.resize(intersectSorted(reinterpret_cast<const int*>(payload()), size(), b.data(), b.size(),
+                                      common.data()));
+    } else {
+        common.clear();
+        for (int value : b) {
+            if (contains(value)) common.push_back(value);
+        }
+    }
+    makeStrictlyAscending(common);
+    Set result;
+    result.assignSorted(common);
+    return result;
+}
+
+// 8-byte values outside the int range cannot be held by a Set and are
+// skipped.
+Set MappedSet::toSet() const {
+    std::vector<int> values;
+    values.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        int64_t value = valueAt(i);
+        if (value >= INT_MIN && value <= INT_MAX) values.push_back(static_cast<int>(value));
+    }
+    makeStrictlyAscending(values);
+    Set result;
+    result.assignSorted(values, workerCount(values.size()));
+    return result;
+}
+
+std::ostream& operator<<(std::ostream& out, const MappedSet& s) {
+    ValueWriter writer(out);
+    for (size_t i = 0; i < s.size(); ++i) writer.write(s.valueAt(i));
+    writer.flush();
+    return out;
+}
+
+bool Set::save(const char* path, bool withChecksum) const {
+    std::vector<int> values;
+    sortedElements(values);
+    SetFileHeader header;
+    std::memcpy(header.magic, SET_FILE_MAGIC, 4);
+    header.version = SET_FILE_VERSION;
+    header.valueWidth = sizeof(int);
+    header.flags = withChecksum ? SET_FILE_HAS_CHECKSUM : 0;
+    header.count = values.size();
+    header.checksum = withChecksum
+        ? payloadChecksum(reinterpret_cast<const unsigned char*>(values.data()), values.size() * sizeof(int))
+        : 0;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int));
+    return static_cast<bool>(out.flush());
+}
+
+bool Set::load(const char* path, bool verifyChecksum) {
+    MappedSet file;
+    if (!file.open(path, verifyChecksum)) return false;
+    unsigned bits = filter.bitsPerValue();
+    size_t bins = sketch.bins();
+    *this = file.toSet();
+    if (bits != 0) enableFilter(bits);
+    if (bins != 0) enableSketch(bins);
+    return true;
+}
+
+// Delta stream format: the magic below, the count, then the values in
+// ascending order, all as varints of seven bits a byte, low bits first,
+// with the high bit set on every byte but the last. The first value is
+// zigzag-encoded so small negatives stay short, every later one is its gap
+// to the one before. Dense sets take about a byte per value.
+const char SET_DELTA_MAGIC[4] = {'S', 'E', 'T', 'V'};
+
+bool Set::writeDeltas(std::ostream& out) const {
+    std::vector<int> values;
+    sortedElements(values);
+    char buffer[1 << 15];
+    size_t used = 0;
+    auto put = [&](uint64_t value) {
+        if (used + 10 > sizeof(buffer)) {
+            out.write(buffer, used);
+            used = 0;
+        }
+        for (; value >= 0x80; value >>= 7) buffer[used++] = static_cast<char>(value | 0x80);
+        buffer[used++] = static_cast<char>(value);
+    };
+    out.write(SET_DELTA_MAGIC, 4);
+    put(values.size());
+    uint32_t previous = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        uint32_t bits = static_cast<uint32_t>(values[i]);
+        put(i == 0 ? (bits << 1) ^ static_cast<uint32_t>(values[i] >> 31) : bits - previous);
+        previous = bits;
+    }
+    out.write(buffer, used);
+    return static_cast<bool>(out);
+}
+
+// Reads a byte at a time off the stream buffer, as operator>> does. The
+// count only bounds the loop; space is reserved as values arrive, so a
+// corrupt count cannot ask for a huge allocation up front.
+bool Set::readDeltas(std::istream& in) {
+    std::istream::sentry guard(in, true);
+    if (!guard) return false;
+    std::streambuf* buf = in.rdbuf();
+    const int eof = std::char_traits<char>::eof();
+    auto get = [&](uint64_t& value, unsigned maxBytes) {
+        value = 0;
+        for (unsigned shift = 0; shift < 7 * maxBytes; shift += 7) {
+            int c = buf->sbumpc();
+            if (c == eof) return false;
+            value |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80)) return true;
+        }
+        return false;
+    };
+    char magic[4];
+    uint64_t count, code;
+    bool ok = buf->sgetn(magic, 4) == 4 && std::memcmp(magic, SET_DELTA_MAGIC, 4) == 0 && get(count, 10);
+    std::vector<int> values;
+    int64_t previous = 0;
+    for (uint64_t i = 0; ok && i < count; ++i) {
+        ok = get(code, 5) && code <= UINT32_MAX;
+        if (!ok) break;
+        int64_t value = i == 0 ? static_cast<int32_t>((code >> 1) ^ (0 - (code & 1))) : previous + int64_t(code);
+        ok = i == 0 || (code != 0 && value <= INT_MAX);
+        values.push_back(static_cast<int>(value));
+        previous = value;
+    }
+    if (!ok) {
+        in.setstate(std::ios_base::failbit);
+        return false;
+    }
+    assignSorted(values, workerCount(values.size()));
+    return true;
+}
+
+// Parses the whitespace-separated ints in [first, last) onto values, with
+// the same rules as operator>>. False at the first token that is not an
+// int or does not fit.
+bool parseInts(const char* first, const char* last, std::vector<int>& values) {
+    const char* at = first;
+    while (true) {
+        while (at != last && std::isspace(static_cast<unsigned char>(*at))) ++at;
+        if (at == last) return true;
+        bool negative = *at == '-';
+        if (*at == '-' || *at == '+') ++at;
+        if (at == last || *at < '0' || *at > '9') return false;
+        uint64_t magnitude = 0;
+        do {
+            magnitude = std::min<uint64_t>(magnitude * 10 + (*at - '0'), uint64_t(INT_MAX) + 2);
+            ++at;
+        } while (at != last && *at >= '0' && *at <= '9');
+        if (magnitude > uint64_t(INT_MAX) + (negative ? 1 : 0)) return false;
+        if (at != last && !std::isspace(static_cast<unsigned char>(*at))) return false;
+        values.push_back(static_cast<int>(negative ? -static_cast<int64_t>(magnitude) : magnitude));
+    }
+}
+
+// The file is mapped and cut into one byte range per thread, each moved
+// forward to the next whitespace so no number straddles two. Every thread
+// parses its range and sorts and dedups what it found, then the runs, and
+// the set's own values, are merged pairwise, each merge range-partitioned
+// across all threads as in parallelUnion. Ranges are at least
+// INGEST_MIN_CHUNK bytes, so small files are read by one thread.
+const size_t INGEST_MIN_CHUNK = 1 << 20;
+
+bool Set::ingestFile(const char* path, unsigned threads) {
+    std::vector<char> buffer;
+    const char* data = nullptr;
+    size_t length = 0;
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    void* mapped = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    data = static_cast<const char*>(mapped);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    length = buffer.size();
+#endif
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t parts = std::max<size_t>(1, std::min<size_t>(threads, length / INGEST_MIN_CHUNK));
+    std::vector<size_t> bounds(parts + 1);
+    bounds[parts] = length;
+    for (size_t k = 1; k < parts; ++k) {
+        size_t at = std::max(bounds[k - 1], length * k / parts);
+        while (at < length && !std::isspace(static_cast<unsigned char>(data[at]))) ++at;
+        bounds[k] = at;
+    }
+    std::vector<std::vector<int>> runs(parts);
+    std::unique_ptr<bool[]> parsed(new bool[parts]);
+    std::vector<std::thread> workers;
+    for (size_t k = 0; k < parts; ++k) {
+        workers.emplace_back([&, k] {
+            std::vector<int>& values = runs[k];
+            values.reserve((bounds[k + 1] - bounds[k]) / 4);
+            parsed[k] = parseInts(data + bounds[k], data + bounds[k + 1], values);
+            std::vector<int> scratch;
+            radixSort(values.data(), values.data() + values.size(), scratch);
+            values.erase(std::unique(values.begin(), values.end()), values.end());
+        });
+    }
+    for (std::thread& t : workers) t.join();
+#if defined(__unix__) || defined(__APPLE__)
+    if (length) munmap(const_cast<char*>(data), length);
+#endif
+    for (size_t k = 0; k < parts; ++k) {
+        if (!parsed[k]) return false;
+    }
+    if (size() != 0) {
+        runs.emplace_back();
+        sortedElements(runs.back());
+    }
+    size_t (*kernel)(const int*, size_t, const int*, size_t, int*) = mergeUnion;
+    while (runs.size() > 1) {
+        std::vector<std::vector<int>> merged((runs.size() + 1) / 2);
+        for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+            shardedMerge(runs[i], runs[i + 1], threads, kernel, merged[i / 2]);
+            std::vector<int>().swap(runs[i]);
+            std::vector<int>().swap(runs[i + 1]);
+        }
+        if (runs.size() % 2) merged.back().swap(runs.back());
+        runs.swap(merged);
+    }
+    assignSorted(runs[0], runs[0].size() < PARALLEL_THRESHOLD ? 1 : threads);
+    return true;
+}
+
+// Insert-only set for many producer threads. Each table uses the same slot
+// layout, hash and load limit as HashTable, but slots are claimed with a
+// compare-and-swap on the plain int, so neither insert nor contains takes
+// a lock. A full table is not resized in place. A table twice its size is
+// chained behind it and new values go there, after the older tables have
+// been searched. freeze() then hands the newest table's slot array to a
+// Set as it is and inserts the few values of the older tables on top.
+//
+// Two threads that insert the same value just as a table fills up can both
+// miss the other's slot and store it in different tables, so size() is an
+// upper bound until the set is frozen. Sizing the set for the expected
+// count keeps the chain at a single table.
+class ConcurrentSet {
+private:
+    static constexpr int EMPTY = INT_MIN;
+    struct Table {
+        std::vector<int> slots;
+        size_t limit;
+        std::atomic<size_t> used;
+        std::atomic<Table*> next;
+        explicit Table(size_t capacity) : slots(capacity, EMPTY), limit(capacity * 7 / 10), used(0), next(nullptr) {}
+    };
+    enum Outcome { ADDED, PRESENT, FULL };
+
+    Table* first;
+    std::atomic<bool> hasEmptyKey;
+
+    static Outcome insertInto(Table& table, int value);
+    static bool findIn(const Table& table, int value);
+    static Table* nextOf(Table& table);
+    void destroy();
+
+public:
+    explicit ConcurrentSet(size_t expected = 0);
+    ~ConcurrentSet() { destroy(); }
+    ConcurrentSet(const ConcurrentSet&) = delete;
+    ConcurrentSet& operator=(const ConcurrentSet&) = delete;
+    bool insert(int value);
+    bool contains(int value) const;
+    size_t size() const;
+    // Moves the contents into a Set and leaves this set empty. No thread
+    // may insert while it runs.
+    Set freeze();
+};
+
+ConcurrentSet::ConcurrentSet(size_t expected) : hasEmptyKey(false) {
+    size_t capacity = 1024;
+    while (expected * 10 >= capacity * 7) capacity *= 2;
+    first = new Table(capacity);
+}
+
+void ConcurrentSet::destroy() {
+    while (first != nullptr) {
+        Table* next = first->next.load(std::memory_order_relaxed);
+        delete first;
+        first = next;
+    }
+}
+
+ConcurrentSet::Outcome ConcurrentSet::insertInto(Table& table, int value) {
+    size_t mask = table.slots.size() - 1;
+    size_t i = HashTable::homeSlot(value, mask);
+    for (size_t probes = 0; probes <= mask; ++probes, i = (i + 1) & mask) {
+        int current = __atomic_load_n(&table.slots[i], __ATOMIC_ACQUIRE);
+        if (current == EMPTY) {
+            if (table.used.load(std::memory_order_relaxed) >= table.limit) return FULL;
+            if (__atomic_compare_exchange_n(&table.slots[i], &current, value, false, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                table.used.fetch_add(1, std::memory_order_relaxed);
+                return ADDED;
+            }
+        }
+        if (current == value) return PRESENT;
+    }
+    return FULL;
+}
+
+bool ConcurrentSet::findIn(const Table& table, int value) {
+    size_t mask = table.slots.size() - 1;
+    size_t i = HashTable::homeSlot(value, mask);
+    for (size_t probes = 0; probes <= mask; ++probes, i = (i + 1) & mask) {
+        int current = __atomic_load_n(&table.slots[i], __ATOMIC_ACQUIRE);
+        if (current == value) return true;
+        if (current == EMPTY) return false;
+    }
+    return false;
+}
+
+ConcurrentSet::Table* ConcurrentSet::nextOf(Table& table) {
+    Table* next = table.next.load(std::memory_order_acquire);
+    if (next != nullptr) return next;
+    Table* grown = new Table(table.slots.size() * 2);
+    if (table.next.compare_exchange_strong(next, grown, std::memory_order_acq_rel)) return grown;
+    delete grown;
+    return next;
+}
+
+bool ConcurrentSet::insert(int value) {
+    if (value == EMPTY) return !hasEmptyKey.exchange(true);
+    for (Table* table = first;; table = nextOf(*table)) {
+        Outcome outcome = insertInto(*table, value);
+        if (outcome != FULL) return outcome == ADDED;
+    }
+}
+
+bool ConcurrentSet::contains(int value) const {
+    if (value == EMPTY) return hasEmptyKey.load();
+    for (const Table* table = first; table != nullptr; table = table->next.load(std::memory_order_acquire)) {
+        if (findIn(*table, value)) return true;
+    }
+    return false;
+}
+
+size_t ConcurrentSet::size() const {
+    size_t total = hasEmptyKey.load() ? 1 : 0;
+    for (const Table* table = first; table != nullptr; table = table->next.load(std::memory_order_acquire)) {
+        total += table->used.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Set ConcurrentSet::freeze() {
+    Table* newest = first;
+    while (newest->next.load() != nullptr) newest = newest->next.load();
+    Set result;
+    result.elements.adopt(newest->slots, newest->used.load());
+    for (Table* table = first; table != newest; table = table->next.load()) {
+        for (int value : table->slots) {
+            if (value != EMPTY) result.elements.insert(value);
+        }
+    }
+    if (hasEmptyKey.exchange(false)) result.elements.insert(EMPTY);
+    destroy();
+    first = new Table(1024);
+    return result;
+}
+
+// Policy-based sets over any integer key type. BasicSet<T, Backend> hands
+// every operation to a backend picked at compile time, so contains, + and *
+// inline straight into the backend with no virtual calls. Set above stays
+// the int set with the filter, file format and parallel operators. The
+// backends are:
+//   SortedListBackend    ascending singly linked list, merges for + and *
+//   SortedVectorBackend  ascending array, binary search and merges
+//   BasicHashTable       the open-addressing table behind Set
+//   WordBitmapBackend    64-bit words keyed by value / 64, kept sorted
+//   BPlusTreeBackend     B+tree with counted subtrees, for rank and ranges
+// A backend has value_type, insert, remove, contains, size and forEach.
+// backendUnion and backendIntersection below work for any of them; a
+// backend that can do better declares its own overloads as friends.
+template <typename B>
+void backendUnion(const B& a, const B& b, B& out) {
+    const B& larger = a.size() >= b.size() ? a : b;
+    const B& smaller = &larger == &a ? b : a;
+    out = larger;
+    smaller.forEach([&out](typename B::value_type value) { out.insert(value); });
+}
+
+template <typename B>
+void backendIntersection(const B& a, const B& b, B& out) {
+    const B& smaller = a.size() <= b.size() ? a : b;
+    const B& larger = &smaller == &a ? b : a;
+    out = B();
+    smaller.forEach([&](typename B::value_type value) {
+        if (larger.contains(value)) out.insert(value);
+    });
+}
+
+template <typename T>
+class SortedListBackend {
+private:
+    struct Node {
+        T data;
+        Node* next;
+    };
+    Node* head;
+    Node* tail;
+    size_t count;
+
+    void append(T value);
+
+public:
+    typedef T value_type;
+    SortedListBackend() : head(nullptr), tail(nullptr), count(0) {}
+    SortedListBackend(const SortedListBackend& other);
+    SortedListBackend(SortedListBackend&& other) noexcept;
+    ~SortedListBackend() { clear(); }
+    SortedListBackend& operator=(SortedListBackend other) noexcept;
+    void clear();
+    bool insert(T value);
+    bool remove(T value);
+    bool contains(T value) const;
+    size_t size() const { return count; }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (Node* current = head; current != nullptr; current = current->next) f(current->data);
+    }
+
+    // One pass over both lists, appending at the tail of the result.
+    friend void backendUnion(const SortedListBackend& a, const SortedListBackend& b, SortedListBackend& out) {
+        SortedListBackend result;
+        Node* x = a.head;
+        Node* y = b.head;
+        while (x != nullptr && y != nullptr) {
+            if (x->data < y->data) {
+                result.append(x->data);
+                x = x->next;
+            } else if (y->data < x->data) {
+                result.append(y->data);
+                y = y->next;
+            } else {
+                result.append(x->data);
+                x = x->next;
+                y = y->next;
+            }
+        }
+        for (; x != nullptr; x = x->next) result.append(x->data);
+        for (; y != nullptr; y = y->next) result.append(y->data);
+        out = std::move(result);
+    }
+
+    friend void backendIntersection(const SortedListBackend& a, const SortedListBackend& b,
+                                    SortedListBackend& out) {
+        SortedListBackend result;
+        Node* x = a.head;
+        Node* y = b.head;
+        while (x != nullptr && y != nullptr) {
+            if (x->data < y->data) {
+                x = x->next;
+            } else if (y->data < x->data) {
+                y = y->next;
+            } else {
+                result.append(x->data);
+                x = x->next;
+                y = y->next;
+            }
+        }
+        out = std::move(result);
+    }
+};
+
+template <typename T>
+SortedListBackend<T>::SortedListBackend(const SortedListBackend& other) : head(nullptr), tail(nullptr), count(0) {
+    other.forEach([this](T value) { append(value); });
+}
+
+template <typename T>
+SortedListBackend<T>::SortedListBackend(SortedListBackend&& other) noexcept
+    : head(other.head), tail(other.tail), count(other.count) {
+    other.head = nullptr;
+    other.tail = nullptr;
+    other.count = 0;
+}
+
+template <typename T>
+SortedListBackend<T>& SortedListBackend<T>::operator=(SortedListBackend other) noexcept {
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+    std::swap(count, other.count);
+    return *this;
+}
+
+template <typename T>
+void SortedListBackend<T>::clear() {
+    while (head != nullptr) {
+        Node* next = head->next;
+        delete head;
+        head = next;
+    }
+    tail = nullptr;
+    count = 0;
+}
+
+template <typename T>
+void SortedListBackend<T>::append(T value) {
+    Node* node = new Node{value, nullptr};
+    if (tail != nullptr) {
+        tail->next = node;
+    } else {
+        head = node;
+    }
+    tail = node;
+    ++count;
+}
+
+// Values larger than the tail go straight to the end, so filling from
+// ascending input is linear.
+template <typename T>
+bool SortedListBackend<T>::insert(T value) {
+    if (tail == nullptr || tail->data < value) {
+        append(value);
+        return true;
+    }
+    Node** link = &head;
+    while ((*link)->data < value) link = &(*link)->next;
+    if ((*link)->data == value) return false;
+    *link = new Node{value, *link};
+    ++count;
+    return true;
+}
+
+template <typename T>
+bool SortedListBackend<T>::remove(T value) {
+    Node* previous = nullptr;
+    Node* current = head;
+    while (current != nullptr && current->data < value) {
+        previous = current;
+        current = current->next;
+    }
+    if (current == nullptr || current->data != value) return false;
+    (previous != nullptr ? previous->next : head) = current->next;
+    if (current == tail) tail = previous;
+    delete current;
+    --count;
+    return true;
+}
+
+template <typename T>
+bool SortedListBackend<T>::contains(T value) const {
+    Node* current = head;
+    while (current != nullptr && current->data < value) current = current->next;
+    return current != nullptr && current->data == value;
+}
+
+// Merges of sorted, duplicate-free vectors. The int overloads go through
+// the dispatched kernels used by Set.
+template <typename T>
+void mergeUnion(const std::vector<T>& a, const std::vector<T>& b, std::vector<T>& out) {
+    out.clear();
+    out.reserve(a.size() + b.size());
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+}
+
+template <typename T>
+void mergeIntersection(const std::vector<T>& a, const std::vector<T>& b, std::vector<T>& out) {
+    const std::vector<T>& small = a.size() <= b.size() ? a : b;
+    const std::vector<T>& large = &small == &a ? b : a;
+    out.clear();
+    if (small.size() * GALLOP_RATIO < large.size()) {
+        typename std::vector<T>::const_iterator from = large.begin();
+        for (T value : small) {
+            from = std::lower_bound(from, large.end(), value);
+            if (from == large.end()) break;
+            if (*from == value) out.push_back(value);
+        }
+        return;
+    }
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+}
+
+inline void mergeUnion(const std::vector<int>& a, const std::vector<int>& b, std::vector<int>& out) {
+    out.resize(a.size() + b.size());
+    out.resize(mergeUnion(a.data(), a.size(), b.data(), b.size(), out.data()));
+}
+
+inline void mergeIntersection(const std::vector<int>& a, const std::vector<int>& b, std::vector<int>& out) {
+    out.resize(std::min(a.size(), b.size()) + 8);
+    out.resize(intersectSorted(a, b, out.data()));
+}
+
+template <typename T>
+class SortedVectorBackend {
+private:
+    std::vector<T> values;
+
+public:
+    typedef T value_type;
+    bool insert(T value);
+    bool remove(T value);
+    bool contains(T value) const { return std::binary_search(values.begin(), values.end(), value); }
+    size_t size() const { return values.size(); }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (T value : values) f(value);
+    }
+
+    friend void backendUnion(const SortedVectorBackend& a, const SortedVectorBackend& b, SortedVectorBackend& out) {
+        std::vector<T> merged;
+        mergeUnion(a.values, b.values, merged);
+        out.values.swap(merged);
+    }
+
+    friend void backendIntersection(const SortedVectorBackend& a, const SortedVectorBackend& b,
+                                    SortedVectorBackend& out) {
+        std::vector<T> common;
+        mergeIntersection(a.values, b.values, common);
+        out.values.swap(common);
+    }
+};
+
+template <typename T>
+bool SortedVectorBackend<T>::insert(T value) {
+    if (values.empty() || values.back() < value) {
+        values.push_back(value);
+        return true;
+    }
+    typename std::vector<T>::iterator at = std::lower_bound(values.begin(), values.end(), value);
+    if (*at == value) return false;
+    values.insert(at, value);
+    return true;
+}
+
+template <typename T>
+bool SortedVectorBackend<T>::remove(T value) {
+    typename std::vector<T>::iterator at = std::lower_bound(values.begin(), values.end(), value);
+    if (at == values.end() || *at != value) return false;
+    values.erase(at);
+    return true;
+}
+
+// Values are mapped to unsigned with the sign bit flipped, so word keys
+// sort in value order for signed types too. Dense ranges such as device
+// indices cost about one bit per value.
+template <typename T>
+class WordBitmapBackend {
+private:
+    typedef typename std::make_unsigned<T>::type Bits;
+    static constexpr Bits SIGN = std::is_signed<T>::value ? Bits(Bits(1) << (sizeof(T) * 8 - 1)) : Bits(0);
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> words;
+    size_t count;
+
+    static uint64_t flip(T value) { return static_cast<Bits>(static_cast<Bits>(value) ^ SIGN); }
+    static T unflip(uint64_t bits) { return static_cast<T>(static_cast<Bits>(static_cast<Bits>(bits) ^ SIGN)); }
+    size_t find(uint64_t key) const { return std::lower_bound(keys.begin(), keys.end(), key) - keys.begin(); }
+
+public:
+    typedef T value_type;
+    WordBitmapBackend() : count(0) {}
+    bool insert(T value);
+    bool remove(T value);
+    bool contains(T value) const;
+    size_t size() const { return count; }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                f(unflip(keys[i] << 6 | __builtin_ctzll(word)));
+            }
+        }
+    }
+
+    friend void backendUnion(const WordBitmapBackend& a, const WordBitmapBackend& b, WordBitmapBackend& out) {
+        WordBitmapBackend result;
+        size_t i = 0, j = 0;
+        while (i < a.keys.size() || j < b.keys.size()) {
+            uint64_t key, word;
+            if (j == b.keys.size() || (i < a.keys.size() && a.keys[i] < b.keys[j])) {
+                key = a.keys[i];
+                word = a.words[i++];
+            } else if (i == a.keys.size() || b.keys[j] < a.keys[i]) {
+                key = b.keys[j];
+                word = b.words[j++];
+            } else {
+                key = a.keys[i];
+                word = a.words[i++] | b.words[j++];
+            }
+            result.keys.push_back(key);
+            result.words.push_back(word);
+            result.count += __builtin_popcountll(word);
+        }
+        out = std::move(result);
+    }
+
+    friend void backendIntersection(const WordBitmapBackend& a, const WordBitmapBackend& b,
+                                    WordBitmapBackend& out) {
+        WordBitmapBackend result;
+        size_t i = 0, j = 0;
+        while (i < a.keys.size() && j < b.keys.size()) {
+            if (a.keys[i] < b.keys[j]) {
+                ++i;
+            } else if (b.keys[j] < a.keys[i]) {
+                ++j;
+            } else {
+                uint64_t word = a.words[i] & b.words[j];
+                if (word != 0) {
+                    result.keys.push_back(a.keys[i]);
+                    result.words.push_back(word);
+                    result.count += __builtin_popcountll(word);
+                }
+                ++i;
+                ++j;
+            }
+        }
+        out = std::move(result);
+    }
+};
+
+template <typename T>
+constexpr typename WordBitmapBackend<T>::Bits WordBitmapBackend<T>::SIGN;
+
+template <typename T>
+bool WordBitmapBackend<T>::insert(T value) {
+    uint64_t bits = flip(value), key = bits >> 6, bit = uint64_t(1) << (bits & 63);
+    size_t i = find(key);
+    if (i == keys.size() || keys[i] != key) {
+        keys.insert(keys.begin() + i, key);
+        words.insert(words.begin() + i, 0);
+    }
+    if (words[i] & bit) return false;
+    words[i] |= bit;
+    ++count;
+    return true;
+}
+
+template <typename T>
+bool WordBitmapBackend<T>::remove(T value) {
+    uint64_t bits = flip(value), key = bits >> 6, bit = uint64_t(1) << (bits & 63);
+    size_t i = find(key);
+    if (i == keys.size() || keys[i] != key || !(words[i] & bit)) return false;
+    words[i] &= ~bit;
+    if (words[i] == 0) {
+        keys.erase(keys.begin() + i);
+        words.erase(words.begin() + i);
+    }
+    --count;
+    return true;
+}
+
+template <typename T>
+bool WordBitmapBackend<T>::contains(T value) const {
+    uint64_t bits = flip(value), key = bits >> 6;
+    size_t i = find(key);
+    return i < keys.size() && keys[i] == key && (words[i] >> (bits & 63) & 1);
+}
+
+// B+tree with fixed-size leaves chained left to right. Inner nodes keep, for
+// every child, a separator (a lower bound on its values) and the number of
+// values below it, so rank, select and range counts add up whole subtrees
+// on the way down instead of walking leaves: O(log n) each. A node that
+// overflows splits in half, or right at the end when the value went last,
+// so ascending inserts leave full leaves. A node that drops below a quarter
+// merges with a neighbour when the two fit in one.
+template <typename T>
+class BPlusTreeBackend {
+private:
+    static const int LEAF_CAPACITY = 64;
+    static const int FANOUT = 32;
+    // Both kinds hold one slot more than their capacity, so an insert goes
+    // in first and the split happens after.
+    struct Node {
+        int count;
+    };
+    struct Leaf : Node {
+        T values[LEAF_CAPACITY + 1];
+        Leaf* next;
+    };
+    struct Inner : Node {
+        T keys[FANOUT + 1];  // keys[0] is unused
+        size_t sizes[FANOUT + 1];
+        Node* children[FANOUT + 1];
+    };
+    struct Split {
+        Node* right;
+        T key;
+        size_t size;
+    };
+    Node* root;
+    unsigned height;  // inner levels above the leaves
+    size_t count;
+
+    static int childIndex(const Inner* node, T value) {
+        int i = 1;
+        while (i < node->count && node->keys[i] <= value) ++i;
+        return i - 1;
+    }
+    static Node* clone(const Node* node, unsigned level, Leaf*& previous);
+    static void destroy(Node* node, unsigned level);
+    static bool insertInto(Node* node, unsigned level, T value, Split& split);
+    static bool removeFrom(Node* node, unsigned level, T value);
+    static void mergeChildren(Inner* node, int i, unsigned level);
+    const Leaf* leafFor(T value) const;
+    size_t countBelow(T value, bool inclusive) const;
+    void assignSorted(const std::vector<T>& values);
+
+public:
+    typedef T value_type;
+    BPlusTreeBackend() : root(nullptr), height(0), count(0) {}
+    BPlusTreeBackend(const BPlusTreeBackend& other);
+    BPlusTreeBackend(BPlusTreeBackend&& other) noexcept;
+    ~BPlusTreeBackend() { clear(); }
+    BPlusTreeBackend& operator=(BPlusTreeBackend other) noexcept;
+    void clear();
+    bool insert(T value);
+    bool remove(T value);
+    bool contains(T value) const;
+    size_t size() const { return count; }
+    // Number of values below value, and of values in [lo, hi].
+    size_t rank(T value) const { return countBelow(value, false); }
+    size_t countInRange(T lo, T hi) const { return lo > hi ? 0 : countBelow(hi, true) - countBelow(lo, false); }
+    // The k-th smallest value, counting from 0. False when k >= size().
+    bool select(size_t k, T& value) const;
+
+    // Calls f on the values in [lo, hi] in ascending order.
+    template <typename F>
+    void rangeIterate(T lo, T hi, F f) const {
+        if (root == nullptr || lo > hi) return;
+        const Leaf* leaf = leafFor(lo);
+        int at = std::lower_bound(leaf->values, leaf->values + leaf->count, lo) - leaf->values;
+        for (; leaf != nullptr; leaf = leaf->next, at = 0) {
+            for (; at < leaf->count; ++at) {
+                if (leaf->values[at] > hi) return;
+                f(leaf->values[at]);
+            }
+        }
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        if (root == nullptr) return;
+        const Node* node = root;
+        for (unsigned level = height; level > 0; --level) node = static_cast<const Inner*>(node)->children[0];
+        for (const Leaf* leaf = static_cast<const Leaf*>(node); leaf != nullptr; leaf = leaf->next) {
+            for (int i = 0; i < leaf->count; ++i) f(leaf->values[i]);
+        }
+    }
+
+    // Merge the two value sequences and bulk-load the result with full
+    // nodes.
+    friend void backendUnion(const BPlusTreeBackend& a, const BPlusTreeBackend& b, BPlusTreeBackend& out) {
+        std::vector<T> x, y, merged;
+        a.forEach([&x](T value) { x.push_back(value); });
+        b.forEach([&y](T value) { y.push_back(value); });
+        mergeUnion(x, y, merged);
+        out.assignSorted(merged);
+    }
+
+    friend void backendIntersection(const BPlusTreeBackend& a, const BPlusTreeBackend& b, BPlusTreeBackend& out) {
+        std::vector<T> x, y, common;
+        a.forEach([&x](T value) { x.push_back(value); });
+        b.forEach([&y](T value) { y.push_back(value); });
+        mergeIntersection(x, y, common);
+        out.assignSorted(common);
+    }
+};
+
+template <typename T>
+BPlusTreeBackend<T>::BPlusTreeBackend(const BPlusTreeBackend& other)
+    : root(nullptr), height(other.height), count(other.count) {
+    Leaf* previous = nullptr;
+    if (other.root != nullptr) root = clone(other.root, height, previous);
+}
+
+template <typename T>
+BPlusTreeBackend<T>::BPlusTreeBackend(BPlusTreeBackend&& other) noexcept
+    : root(other.root), height(other.height), count(other.count) {
+    other.root = nullptr;
+    other.height = 0;
+    other.count = 0;
+}
+
+template <typename T>
+BPlusTreeBackend<T>& BPlusTreeBackend<T>::operator=(BPlusTreeBackend other) noexcept {
+    std::swap(root, other.root);
+    std::swap(height, other.height);
+    std::swap(count, other.count);
+    return *this;
+}
+
+template <typename T>
+void BPlusTreeBackend<T>::clear() {
+    if (root != nullptr) destroy(root, height);
+    root = nullptr;
+    height = 0;
+    count = 0;
+}
+
+// Leaves are copied in order, so each one is linked behind the previous.
+template <typename T>
+typename BPlusTreeBackend<T>::Node* BPlusTreeBackend<T>::clone(const Node* node, unsigned level, Leaf*& previous) {
+    if (level == 0) {
+        Leaf* leaf = new Leaf(*static_cast<const Leaf*>(node));
+        leaf->next = nullptr;
+        if (previous != nullptr) previous->next = leaf;
+        previous = leaf;
+        return leaf;
+    }
+    Inner* copy = new Inner(*static_cast<const Inner*>(node));
+    for (int i = 0; i < copy->count; ++i) copy->children[i] = clone(copy->children[i], level - 1, previous);
+    return copy;
+}
+
+template <typename T>
+void BPlusTreeBackend<T>::destroy(Node* node, unsigned level) {
+    if (level == 0) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for (int i = 0; i < inner->count; ++i) destroy(inner->children[i], level - 1);
+    delete inner;
+}
+
+template <typename T>
+bool BPlusTreeBackend<T>::insert(T value) {
+    if (root == nullptr) {
+        Leaf* leaf = new Leaf;
+        leaf->count = 1;
+        leaf->values[0] = value;
+        leaf->next = nullptr;
+        root = leaf;
+        count = 1;
+        return true;
+    }
+    Split split;
+    if (!insertInto(root, height, value, split)) return false;
+    ++count;
+    if (split.right != nullptr) {
+        Inner* top = new Inner;
+        top->count = 2;
+        top->children[0] = root;
+        top->sizes[0] = count - split.size;
+        top->children[1] = split.right;
+        top->sizes[1] = split.size;
+        top->keys[1] = split.key;
+        root = top;
+        ++height;
+    }
+    return true;
+}
+
+template <typename T>
+bool BPlusTreeBackend<T>::insertInto(Node* node, unsigned level, T value, Split& split) {
+    split.right = nullptr;
+    if (level == 0) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        T* at = std::lower_bound(leaf->values, leaf->values + leaf->count, value);
+        if (at != leaf->values + leaf->count && *at == value) return false;
+        bool last = at == leaf->values + leaf->count;
+        std::copy_backward(at, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        *at = value;
+        if (++leaf->count <= LEAF_CAPACITY) return true;
+        int keep = last ? LEAF_CAPACITY : leaf->count / 2;
+        Leaf* right = new Leaf;
+        right->count = leaf->count - keep;
+        std::copy(leaf->values + keep, leaf->values + leaf->count, right->values);
+        right->next = leaf->next;
+        leaf->next = right;
+        leaf->count = keep;
+        split.right = right;
+        split.key = right->values[0];
+        split.size = right->count;
+        return true;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    int i = childIndex(inner, value);
+    Split below;
+    if (!insertInto(inner->children[i], level - 1, value, below)) return false;
+    ++inner->sizes[i];
+    if (below.right == nullptr) return true;
+    inner->sizes[i] -= below.size;
+    bool last = i + 1 == inner->count;
+    for (int j = inner->count; j > i + 1; --j) {
+        inner->keys[j] = inner->keys[j - 1];
+        inner->sizes[j] = inner->sizes[j - 1];
+        inner->children[j] = inner->children[j - 1];
+    }
+    inner->keys[i + 1] = below.key;
+    inner->sizes[i + 1] = below.size;
+    inner->children[i + 1] = below.right;
+    if (++inner->count <= FANOUT) return true;
+    int keep = last ? FANOUT : inner->count / 2;
+    Inner* right = new Inner;
+    right->count = inner->count - keep;
+    split.size = 0;
+    for (int j = keep; j < inner->count; ++j) {
+        right->keys[j - keep] = inner->keys[j];
+        right->sizes[j - keep] = inner->sizes[j];
+        right->children[j - keep] = inner->children[j];
+        split.size += inner->sizes[j];
+    }
+    inner->count = keep;
+    split.right = right;
+    split.key = right->keys[0];
+    return true;
+}
+
+template <typename T>
+bool BPlusTreeBackend<T>::remove(T value) {
+    if (root == nullptr || !removeFrom(root, height, value)) return false;
+    --count;
+    while (height > 0 && root->count == 1) {
+        Inner* top = static_cast<Inner*>(root);
+        root = top->children[0];
+        delete top;
+        --height;
+    }
+    if (count == 0) clear();
+    return true;
+}
+
+template <typename T>
+bool BPlusTreeBackend<T>::removeFrom(Node* node, unsigned level, T value) {
+    if (level == 0) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        T* at = std::lower_bound(leaf->values, leaf->values + leaf->count, value);
+        if (at == leaf->values + leaf->count || *at != value) return false;
+        std::copy(at + 1, leaf->values + leaf->count, at);
+        --leaf->count;
+        return true;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    int i = childIndex(inner, value);
+    if (!removeFrom(inner->children[i], level - 1, value)) return false;
+    --inner->sizes[i];
+    int capacity = level == 1 ? LEAF_CAPACITY : FANOUT;
+    if (inner->count > 1 && inner->children[i]->count < capacity / 4) {
+        int left = i + 1 < inner->count ? i : i - 1;
+        if (inner->children[left]->count + inner->children[left + 1]->count <= capacity) {
+            mergeChildren(inner, left, level);
+        }
+    }
+    return true;
+}
+
+// Folds child i + 1 into child i. The separator in front of the right
+// child becomes the key of its first child inside the merged node.
+template <typename T>
+void BPlusTreeBackend<T>::mergeChildren(Inner* node, int i, unsigned level) {
+    if (level == 1) {
+        Leaf* left = static_cast<Leaf*>(node->children[i]);
+        Leaf* right = static_cast<Leaf*>(node->children[i + 1]);
+        std::copy(right->values, right->values + right->count, left->values + left->count);
+        left->count += right->count;
+        left->next = right->next;
+        delete right;
+    } else {
+        Inner* left = static_cast<Inner*>(node->children[i]);
+        Inner* right = static_cast<Inner*>(node->children[i + 1]);
+        right->keys[0] = node->keys[i + 1];
+        for (int j = 0; j < right->count; ++j) {
+            left->keys[left->count + j] = right->keys[j];
+            left->sizes[left->count + j] = right->sizes[j];
+            left->children[left->count + j] = right->children[j];
+        }
+        left->count += right->count;
+        delete right;
+    }
+    node->sizes[i] += node->sizes[i + 1];
+    for (int j = i + 1; j + 1 < node->count; ++j) {
+        node->keys[j] = node->keys[j + 1];
+        node->sizes[j] = node->sizes[j + 1];
+        node->children[j] = node->children[j + 1];
+    }
+    --node->count;
+}
+
+template <typename T>
+const typename BPlusTreeBackend<T>::Leaf* BPlusTreeBackend<T>::leafFor(T value) const {
+    const Node* node = root;
+    for (unsigned level = height; level > 0; --level) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[childIndex(inner, value)];
+    }
+    return static_cast<const Leaf*>(node);
+}
+
+template <typename T>
+bool BPlusTreeBackend<T>::contains(T value) const {
+    if (root == nullptr) return false;
+    const Leaf* leaf = leafFor(value);
+    const T* at = std::lower_bound(leaf->values, leaf->values + leaf->count, value);
+    return at != leaf->values + leaf->count && *at == value;
+}
+
+template <typename T>
+size_t BPlusTreeBackend<T>::countBelow(T value, bool inclusive) const {
+    if (root == nullptr) return 0;
+    size_t below = 0;
+    const Node* node = root;
+    for (unsigned level = height; level > 0; --level) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        int i = childIndex(inner, value);
+        for (int j = 0; j < i; ++j) below += inner->sizes[j];
+        node = inner->children[i];
+    }
+    const Leaf* leaf = static_cast<const Leaf*>(node);
+    const T* end = leaf->values + leaf->count;
+    return below + ((inclusive ? std::upper_bound(leaf->values, end, value) : std::lower_bound(leaf->values, end, value)) -
+                    leaf->values);
+}
+
+template <typename T>
+bool BPlusTreeBackend<T>::select(size_t k, T& value) const {
+    if (k >= count) return false;
+    const Node* node = root;
+    for (unsigned level = height; level > 0; --level) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        int i = 0;
+        while (k >= inner->sizes[i]) k -= inner->sizes[i++];
+        node = inner->children[i];
+    }
+    value = static_cast<const Leaf*>(node)->values[k];
+    return true;
+}
+
+// Fills leaves to capacity, then builds each inner level over the one below.
+template <typename T>
+void BPlusTreeBackend<T>::assignSorted(const std::vector<T>& values) {
+    clear();
+    if (values.empty()) return;
+    std::vector<Node*> level;
+    std::vector<size_t> sizes;
+    std::vector<T> firsts;
+    Leaf* previous = nullptr;
+    for (size_t begin = 0; begin < values.size(); begin += LEAF_CAPACITY) {
+        Leaf* leaf = new Leaf;
+        leaf->count = static_cast<int>(std::min<size_t>(LEAF_CAPACITY, values.size() - begin));
+        std::copy(values.begin() + begin, values.begin() + begin + leaf->count, leaf->values);
+        leaf->next = nullptr;
+        if (previous != nullptr) previous->next = leaf;
+        previous = leaf;
+        level.push_back(leaf);
+        sizes.push_back(leaf->count);
+        firsts.push_back(leaf->values[0]);
+    }
+    while (level.size() > 1) {
+        std::vector<Node*> parents;
+        std::vector<size_t> parentSizes;
+        std::vector<T> parentFirsts;
+        for (size_t begin = 0; begin < level.size(); begin += FANOUT) {
+            Inner* inner = new Inner;
+            inner->count = static_cast<int>(std::min<size_t>(FANOUT, level.size() - begin));
+            size_t total = 0;
+            for (int j = 0; j < inner->count; ++j) {
+                inner->keys[j] = firsts[begin + j];
+                inner->sizes[j] = sizes[begin + j];
+                inner->children[j] = level[begin + j];
+                total += sizes[begin + j];
+            }
+            parents.push_back(inner);
+            parentSizes.push_back(total);
+            parentFirsts.push_back(firsts[begin]);
+        }
+        level.swap(parents);
+        sizes.swap(parentSizes);
+        firsts.swap(parentFirsts);
+        ++height;
+    }
+    root = level[0];
+    count = values.size();
+}
+
+template <typename T, template <typename> class Backend = BasicHashTable>
+class BasicSet {
+private:
+    static_assert(std::is_integral<T>::value, "BasicSet keys must be integers");
+    Backend<T> store;
+
+public:
+    typedef T value_type;
+    typedef Backend<T> backend_type;
+    BasicSet() {}
+    BasicSet(const T arr[], size_t size);
+    bool contains(T value) const { return store.contains(value); }
+    size_t size() const { return store.size(); }
+    const backend_type& backend() const { return store; }
+    // Ordered queries; only backends that keep values in order have them.
+    size_t rank(T value) const { return store.rank(value); }
+    size_t countInRange(T lo, T hi) const { return store.countInRange(lo, hi); }
+    bool select(size_t k, T& value) const { return store.select(k, value); }
+    template <typename F>
+    void rangeIterate(T lo, T hi, F f) const {
+        store.rangeIterate(lo, hi, f);
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        store.forEach(f);
+    }
+
+    BasicSet& operator+=(T value) {
+        store.insert(value);
+        return *this;
+    }
+
+    BasicSet& operator-=(T value) {
+        store.remove(value);
+        return *this;
+    }
+
+    BasicSet operator+(const BasicSet& other) const {
+        BasicSet result;
+        backendUnion(store, other.store, result.store);
+        return result;
+    }
+
+    BasicSet operator*(const BasicSet& other) const {
+        BasicSet result;
+        backendIntersection(store, other.store, result.store);
+        return result;
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const BasicSet& s) {
+        ValueWriter writer(out);
+        s.forEach([&writer](T value) { writer.write(value); });
+        writer.flush();
+        return out;
+    }
+};
+
+// Sorting first lets the ordered backends append every value at the end.
+template <typename T, template <typename> class Backend>
+BasicSet<T, Backend>::BasicSet(const T arr[], size_t size) {
+    std::vector<T> values(arr, arr + size);
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    for (T value : values) store.insert(value);
+}
+
+#ifdef SET_BENCHMARK
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+
+// Benchmark suite. Build with -O2 -pthread -DSET_BENCHMARK and pass the
+// largest size to run (default 1000000, up to 100000000). The output is a
+// JSON array with one record per measurement: ns per op, heap allocations
+// per op, and the peak RSS of the process so far.
+std::atomic<size_t> allocationCount(0);
+
+// Kept out of line so the compiler does not pair the malloc and free
+// inside with the new and delete expressions it inlines them into.
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++allocationCount;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t align) {
+    ++allocationCount;
+    size_t alignment = static_cast<size_t>(align);
+    if (void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+struct Measurement {
+    double seconds;
+    size_t allocations;
+    Measurement() : seconds(0), allocations(0) {}
+};
+
+template <typename F>
+void measure(Measurement& m, F f) {
+    size_t before = allocationCount;
+    auto start = std::chrono::steady_clock::now();
+    f();
+    m.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m.allocations += allocationCount - before;
+}
+
+long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+bool firstRecord = true;
+
+// extra is appended to the record as is, e.g. ",\"threads\":4".
+void report(const std::string& bench, const std::string& backend, const std::string& distribution,
+            size_t size, double ops, const Measurement& m, const std::string& extra = "") {
+    std::cout << (firstRecord ? "[\n" : ",\n") << "{\"bench\":\"" << bench << "\",\"backend\":\"" << backend
+              << "\",\"distribution\":\"" << distribution << "\",\"size\":" << size
+              << ",\"ns_per_op\":" << m.seconds * 1e9 / ops << ",\"allocs_per_op\":" << m.allocations / ops
+              << ",\"peak_rss_kb\":" << peakRssKb() << extra << "}";
+    firstRecord = false;
+}
+
+volatile size_t benchSink;
+
+std::vector<int> generate(const std::string& distribution, size_t n, std::mt19937& rng) {
+    std::vector<int> values(n);
+    int range = static_cast<int>(std::min<size_t>(n * 4, INT_MAX / 2));
+    if (distribution == "uniform") {
+        std::uniform_int_distribution<int> dist(0, range);
+        for (int& v : values) v = dist(rng);
+    } else if (distribution == "clustered") {
+        // Runs of 64 to 1024 consecutive values at random starting points.
+        std::uniform_int_distribution<int> start(0, range), length(64, 1024);
+        for (size_t i = 0; i < n;) {
+            int first = start(rng), len = length(rng);
+            for (int k = 0; k < len && i < n; ++k) values[i++] = first + k;
+        }
+    } else {
+        // Power law: small values are drawn far more often than large ones.
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int& v : values) v = static_cast<int>(std::pow(unit(rng), 4) * range);
+    }
+    return values;
+}
+
+// Half of the probes are members, half are drawn from the same range.
+std::vector<int> makeProbes(const std::vector<int>& values, std::mt19937& rng) {
+    std::vector<int> probes(values.size());
+    std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+    std::uniform_int_distribution<int> any(0, static_cast<int>(std::min<size_t>(values.size() * 4, INT_MAX / 2)));
+    for (size_t i = 0; i < probes.size(); ++i) probes[i] = i % 2 ? values[pick(rng)] : any(rng);
+    return probes;
+}
+
+size_t repetitions(size_t n) {
+    return std::max<size_t>(1, 100000 / n);
+}
+
+void benchSet(const std::string& distribution, const std::vector<int>& a, const std::vector<int>& b,
+              const std::vector<int>& probes) {
+    size_t n = a.size(), reps = repetitions(n);
+    Measurement insert, bulk, contains, batch, mask, remove, unite, intersect, copy, ingest, extract;
+    Measurement output, formatted, dump, restore;
+    for (size_t r = 0; r < reps; ++r) {
+        measure(insert, [&] {
+            Set s;
+            for (int v : a) s += v;
+        });
+        measure(bulk, [&] { Set s(a.data(), n); });
+    }
+    Set setA(a.data(), n), setB(b.data(), b.size());
+    std::unique_ptr<bool[]> found(new bool[probes.size()]);
+    std::vector<uint64_t> bits((probes.size() + 63) / 64);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(contains, [&] {
+            size_t hits = 0;
+            for (int p : probes) hits += setA.contains(p);
+            benchSink = hits;
+        });
+        measure(batch, [&] { setA.containsBatch(probes.data(), probes.size(), found.get()); });
+        measure(mask, [&] { benchSink = setA.containsBatch(probes.data(), probes.size(), bits.data()); });
+        Set victim = setA;
+        measure(remove, [&] {
+            for (int v : a) victim -= v;
+        });
+        measure(unite, [&] { Set u = setA + setB; });
+        measure(intersect, [&] { Set i = setA * setB; });
+        Set target;
+        measure(copy, [&] { target = setA; });
+    }
+    std::ostringstream text;
+    for (int v : a) text << v << ' ';
+    std::string input = text.str();
+    for (size_t r = 0; r < reps; ++r) {
+        measure(ingest, [&] {
+            std::istringstream in(input);
+            Set s;
+            in >> s;
+        });
+        measure(extract, [&] {
+            std::istringstream in(input);
+            HashTable table;
+            int value;
+            while (in >> value) table.insert(value);
+        });
+    }
+    std::string binary;
+    for (size_t r = 0; r < reps; ++r) {
+        measure(output, [&] {
+            std::ostringstream out;
+            out << setA;
+            benchSink = out.tellp();
+        });
+        measure(formatted, [&] {
+            std::ostringstream out;
+            setA.forEach([&out](int value) { out << value << " "; });
+            benchSink = out.tellp();
+        });
+        measure(dump, [&] {
+            std::ostringstream out;
+            setA.writeDeltas(out);
+            binary = out.str();
+        });
+        measure(restore, [&] {
+            std::istringstream in(binary);
+            Set s;
+            s.readDeltas(in);
+        });
+    }
+    std::ostringstream ingestRate, extractRate, deltaSize;
+    ingestRate << ",\"mb_per_s\":" << input.size() * reps / 1e6 / ingest.seconds;
+    extractRate << ",\"mb_per_s\":" << input.size() * reps / 1e6 / extract.seconds;
+    deltaSize << ",\"bytes_per_value\":" << double(binary.size()) / std::max<size_t>(1, setA.size());
+    report("insert", "set", distribution, n, double(n) * reps, insert);
+    report("bulk_build", "set", distribution, n, double(n) * reps, bulk);
+    report("contains", "set", distribution, n, double(probes.size()) * reps, contains);
+    report("contains_batch", "set", distribution, n, double(probes.size()) * reps, batch);
+    report("contains_batch_mask", "set", distribution, n, double(probes.size()) * reps, mask);
+    report("remove", "set", distribution, n, double(n) * reps, remove);
+    report("union", "set", distribution, n, double(n + b.size()) * reps, unite);
+    report("intersection", "set", distribution, n, double(n + b.size()) * reps, intersect);
+    report("copy_assign", "set", distribution, n, double(setA.size()) * reps, copy);
+    report("stream_ingest", "set", distribution, n, double(n) * reps, ingest, ingestRate.str());
+    report("stream_ingest", "int_extraction_loop", distribution, n, double(n) * reps, extract, extractRate.str());
+    report("stream_output", "set", distribution, n, double(setA.size()) * reps, output);
+    report("stream_output", "formatted_loop", distribution, n, double(setA.size()) * reps, formatted);
+    report("delta_dump", "set", distribution, n, double(setA.size()) * reps, dump, deltaSize.str());
+    report("delta_restore", "set", distribution, n, double(setA.size()) * reps, restore, deltaSize.str());
+}
+
+void benchBitmap(const std::string& distribution, const std::vector<int>& a, const std::vector<int>& b,
+                 const std::vector<int>& probes) {
+    size_t n = a.size(), reps = repetitions(n);
+    Measurement insert, bulk, contains, unite, intersect, copy;
+    for (size_t r = 0; r < reps; ++r) {
+        measure(insert, [&] {
+            CompressedBitmap s;
+            for (int v : a) s += v;
+        });
+        measure(bulk, [&] { CompressedBitmap s(a.data(), n); });
+    }
+    CompressedBitmap bitmapA(a.data(), n), bitmapB(b.data(), b.size());
+    for (size_t r = 0; r < reps; ++r) {
+        measure(contains, [&] {
+            size_t hits = 0;
+            for (int p : probes) hits += bitmapA.contains(p);
+            benchSink = hits;
+        });
+        measure(unite, [&] { CompressedBitmap u = bitmapA + bitmapB; });
+        measure(intersect, [&] { CompressedBitmap i = bitmapA * bitmapB; });
+        CompressedBitmap target;
+        measure(copy, [&] { target = bitmapA; });
+    }
+    report("insert", "compressed_bitmap", distribution, n, double(n) * reps, insert);
+    report("bulk_build", "compressed_bitmap", distribution, n, double(n) * reps, bulk);
+    report("contains", "compressed_bitmap", distribution, n, double(probes.size()) * reps, contains);
+    report("union", "compressed_bitmap", distribution, n, double(n + b.size()) * reps, unite);
+    report("intersection", "compressed_bitmap", distribution, n, double(n + b.size()) * reps, intersect);
+    report("copy_assign", "compressed_bitmap", distribution, n, double(bitmapA.size()) * reps, copy);
+}
+
+// LinkedList is the original representation (also the one in
+// as1submit.cpp); union and intersection are the contains loops the old
+// Set operators ran.
+template <typename List>
+void benchList(const std::string& backend, const std::string& distribution, const std::vector<int>& a,
+               const std::vector<int>& b, const std::vector<int>& probes) {
+    size_t n = a.size(), reps = repetitions(n);
+    Measurement insert, contains, remove, unite, intersect, copy;
+    for (size_t r = 0; r < reps; ++r) {
+        measure(insert, [&] {
+            List list;
+            for (int v : a) list.insert(v);
+        });
+    }
+    List listA, listB;
+    for (int v : a) listA.insert(v);
+    for (int v : b) listB.insert(v);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(contains, [&] {
+            size_t hits = 0;
+            for (int p : probes) hits += listA.contains(p);
+            benchSink = hits;
+        });
+        List victim = listA;
+        measure(remove, [&] {
+            for (int v : a) victim.remove(v);
+        });
+        measure(unite, [&] {
+            List u = listA;
+            for (int v : b) u.insert(v);
+        });
+        measure(intersect, [&] {
+            List i;
+            for (int v : a) {
+                if (listB.contains(v)) i.insert(v);
+            }
+        });
+        List target;
+        measure(copy, [&] { target = listA; });
+    }
+    report("insert", backend, distribution, n, double(n) * reps, insert);
+    report("contains", backend, distribution, n, double(probes.size()) * reps, contains);
+    report("remove", backend, distribution, n, double(n) * reps, remove);
+    report("union", backend, distribution, n, double(n + b.size()) * reps, unite);
+    report("intersection", backend, distribution, n, double(n + b.size()) * reps, intersect);
+    report("copy_assign", backend, distribution, n, double(n) * reps, copy);
+}
+
+void benchIntersectKernels(size_t n, std::mt19937& rng) {
+    std::vector<int> sa = generate("uniform", n, rng), sb = generate("uniform", n, rng);
+    for (std::vector<int>* v : {&sa, &sb}) {
+        std::sort(v->begin(), v->end());
+        v->erase(std::unique(v->begin(), v->end()), v->end());
+    }
+    std::vector<std::pair<std::string, IntersectKernel>> kernels;
+    kernels.push_back(std::make_pair("scalar", intersectScalar));
+#ifdef SET_X86_SIMD
+    if (__builtin_cpu_supports("sse4.2")) kernels.push_back(std::make_pair("sse4.2", intersectSse));
+    if (__builtin_cpu_supports("avx2")) kernels.push_back(std::make_pair("avx2", intersectAvx2));
+#endif
+    std::vector<int> out(std::min(sa.size(), sb.size()) + 8);
+    size_t reps = repetitions(n) * 10;
+    for (const auto& kernel : kernels) {
+        Measurement full, count;
+        for (size_t r = 0; r < reps; ++r) {
+            measure(full, [&] { benchSink = kernel.second(sa.data(), sa.size(), sb.data(), sb.size(), out.data()); });
+            measure(count, [&] { benchSink = kernel.second(sa.data(), sa.size(), sb.data(), sb.size(), nullptr); });
+        }
+        report("intersect_kernel", kernel.first, "uniform", n, double(sa.size() + sb.size()) * reps, full);
+        report("intersect_count", kernel.first, "uniform", n, double(sa.size() + sb.size()) * reps, count);
+    }
+}
+
+// Every node used to cost one new and one delete; the pool only allocates
+// when a block runs out.
+void benchListChurn(std::mt19937& rng) {
+    const int size = 2000, rounds = 50000;
+    LinkedList::NodePool shared;
+    LinkedList sharedList(shared);
+    std::uniform_int_distribution<int> dist(0, size * 2);
+    Measurement churn;
+    measure(churn, [&] {
+        for (int i = 0; i < size; ++i) sharedList.insert(i);
+        for (int r = 0; r < rounds; ++r) {
+            sharedList.remove(dist(rng));
+            sharedList.insert(dist(rng));
+        }
+    });
+    std::ostringstream extra;
+    extra << ",\"node_allocations_before\":" << shared.nodesServed()
+          << ",\"block_allocations_after\":" << shared.blockCount();
+    report("list_churn", "node_pool", "uniform", size, double(size + rounds * 2), churn, extra.str());
+}
+
+// The BasicSet backends on 64-bit keys above 2^40, spread over a range
+// eight times the set size so the word bitmap sees a realistic fill.
+template <template <typename> class Backend>
+void benchBackend(const std::string& backend, size_t n, std::mt19937& rng) {
+    const int64_t base = int64_t(1) << 40;
+    std::uniform_int_distribution<int64_t> any(base, base + int64_t(n) * 8);
+    std::vector<int64_t> a(n), b(n), probes(n);
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = any(rng);
+        b[i] = any(rng);
+        probes[i] = i % 2 ? a[i] : any(rng);
+    }
+    size_t reps = repetitions(n);
+    Measurement bulk, contains, unite, intersect;
+    BasicSet<int64_t, Backend> setA(a.data(), n), setB(b.data(), n);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(bulk, [&] { BasicSet<int64_t, Backend> s(a.data(), n); });
+        measure(contains, [&] {
+            size_t hits = 0;
+            for (int64_t p : probes) hits += setA.contains(p);
+            benchSink = hits;
+        });
+        measure(unite, [&] { BasicSet<int64_t, Backend> u = setA + setB; });
+        measure(intersect, [&] { BasicSet<int64_t, Backend> i = setA * setB; });
+    }
+    report("bulk_build", backend, "int64_uniform", n, double(n) * reps, bulk);
+    report("contains", backend, "int64_uniform", n, double(n) * reps, contains);
+    report("union", backend, "int64_uniform", n, double(2 * n) * reps, unite);
+    report("intersection", backend, "int64_uniform", n, double(2 * n) * reps, intersect);
+}
+
+// Range counts, rank and select on the B+tree against answering the same
+// range count with a full scan of a hash Set, which is all Set can do.
+void benchOrdered(size_t n, std::mt19937& rng) {
+    std::vector<int> a = generate("uniform", n, rng);
+    std::vector<int64_t> wide(a.begin(), a.end());
+    BasicSet<int64_t, BPlusTreeBackend> tree(wide.data(), n);
+    Set set(a.data(), n);
+    std::uniform_int_distribution<int> any(0, static_cast<int>(n * 4));
+    const size_t queries = 100000;
+    std::vector<int> lows(queries);
+    for (int& v : lows) v = any(rng);
+    Measurement count, rank, select, iterate, scan;
+    measure(count, [&] {
+        size_t total = 0;
+        for (int lo : lows) total += tree.countInRange(lo, lo + 1000);
+        benchSink = total;
+    });
+    measure(rank, [&] {
+        size_t total = 0;
+        for (int lo : lows) total += tree.rank(lo);
+        benchSink = total;
+    });
+    measure(select, [&] {
+        int64_t value, total = 0;
+        for (size_t i = 0; i < queries; ++i) total += tree.select(size_t(lows[i]) % n, value) ? value : 0;
+        benchSink = total;
+    });
+    measure(iterate, [&] {
+        int64_t total = 0;
+        for (int lo : lows) tree.rangeIterate(lo, lo + 1000, [&total](int64_t v) { total += v; });
+        benchSink = total;
+    });
+    size_t scans = std::max<size_t>(1, queries * 1000 / n / 100);
+    measure(scan, [&] {
+        size_t total = 0;
+        for (size_t i = 0; i < scans; ++i) {
+            set.forEach([&](int v) { total += v >= lows[i] && v <= lows[i] + 1000; });
+        }
+        benchSink = total;
+    });
+    report("count_in_range", "basic_set_bplus_tree", "uniform", n, double(queries), count);
+    report("count_in_range", "set_scan", "uniform", n, double(scans), scan);
+    report("rank", "basic_set_bplus_tree", "uniform", n, double(queries), rank);
+    report("select", "basic_set_bplus_tree", "uniform", n, double(queries), select);
+    report("range_iterate_1000", "basic_set_bplus_tree", "uniform", n, double(queries), iterate);
+}
+
+// Miss-heavy probes (nine in ten absent) against the same set with and
+// without its Bloom filter, one at a time and in batches, plus an
+// intersection with a set a hundred times smaller.
+void benchBloomFilter(size_t n, std::mt19937& rng) {
+    std::vector<int> a = generate("uniform", n, rng);
+    std::vector<int> probes(n), small(std::max<size_t>(1, n / 100));
+    std::uniform_int_distribution<size_t> pick(0, n - 1);
+    std::uniform_int_distribution<int> any(INT_MIN, INT_MAX);
+    for (size_t i = 0; i < n; ++i) probes[i] = i % 10 ? any(rng) : a[pick(rng)];
+    for (int& v : small) v = a[pick(rng)] + static_cast<int>(pick(rng) % 2);
+    Set smallSet(small.data(), small.size());
+    std::unique_ptr<bool[]> found(new bool[n]);
+    for (int filtered = 0; filtered < 2; ++filtered) {
+        Set s(a.data(), n);
+        if (filtered) s.enableFilter();
+        Measurement single, batch, intersect;
+        size_t reps = repetitions(n);
+        for (size_t r = 0; r < reps; ++r) {
+            measure(single, [&] {
+                size_t hits = 0;
+                for (int p : probes) hits += s.contains(p);
+                benchSink = hits;
+            });
+            measure(batch, [&] { s.containsBatch(probes.data(), n, found.get()); });
+            measure(intersect, [&] { Set i = smallSet * s; });
+        }
+        const char* backend = filtered ? "set_bloom" : "set";
+        report("contains_miss_heavy", backend, "uniform", n, double(n) * reps, single);
+        report("contains_batch_miss_heavy", backend, "uniform", n, double(n) * reps, batch);
+        report("intersection_small_large", backend, "uniform", n, double(small.size()) * reps, intersect);
+    }
+}
+
+// Producers insert disjoint slices of one input into a shared set: the
+// lock-free ConcurrentSet against a Set behind a mutex. Thread counts go
+// past the core count on purpose.
+void benchConcurrentScaling(size_t n, std::mt19937& rng) {
+    std::vector<int> values = generate("uniform", n, rng);
+    for (unsigned threads = 1; threads <= 32; threads *= 2) {
+        Measurement lockFree, locked, freeze;
+        auto run = [&](auto insert) {
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i) insert(values[i]);
+                });
+            }
+            for (std::thread& w : workers) w.join();
+        };
+        ConcurrentSet shared(n);
+        measure(lockFree, [&] { run([&](int value) { shared.insert(value); }); });
+        measure(freeze, [&] { Set frozen = shared.freeze(); });
+        Set guarded;
+        std::mutex guard;
+        measure(locked, [&] {
+            run([&](int value) {
+                std::lock_guard<std::mutex> hold(guard);
+                guarded += value;
+            });
+        });
+        std::ostringstream extra;
+        extra << ",\"threads\":" << threads;
+        report("concurrent_insert", "concurrent_set", "uniform", n, double(n), lockFree, extra.str());
+        report("concurrent_insert", "mutex_set", "uniform", n, double(n), locked, extra.str());
+        report("freeze", "concurrent_set", "uniform", n, double(n), freeze, extra.str());
+    }
+}
+
+// A shuffled contiguous range, the case IntervalSet is for, against Set.
+void benchIntervals(size_t n, std::mt19937& rng) {
+    std::vector<int> a(n), b(n), probes = generate("uniform", n, rng);
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = static_cast<int>(i);
+        b[i] = static_cast<int>(i + n / 2);
+    }
+    std::shuffle(a.begin(), a.end(), rng);
+    Measurement bulk, contains, unite, intersect, setBulk, setUnite;
+    IntervalSet spansA(a.data(), n), spansB(b.data(), n);
+    Set setA(a.data(), n), setB(b.data(), n);
+    size_t reps = repetitions(n);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(bulk, [&] { IntervalSet s(a.data(), n); });
+        measure(contains, [&] {
+            size_t hits = 0;
+            for (int p : probes) hits += spansA.contains(p);
+            benchSink = hits;
+        });
+        measure(unite, [&] { IntervalSet u = spansA + spansB; });
+        measure(intersect, [&] { IntervalSet i = spansA * spansB; });
+        measure(setBulk, [&] { Set s(a.data(), n); });
+        measure(setUnite, [&] { Set u = setA + setB; });
+    }
+    std::ostringstream extra;
+    extra << ",\"spans\":" << spansA.spanCount();
+    report("bulk_build", "interval_set", "contiguous", n, double(n) * reps, bulk, extra.str());
+    report("contains", "interval_set", "contiguous", n, double(n) * reps, contains, extra.str());
+    report("union", "interval_set", "contiguous", n, double(2 * n) * reps, unite, extra.str());
+    report("intersection", "interval_set", "contiguous", n, double(2 * n) * reps, intersect, extra.str());
+    report("bulk_build", "set", "contiguous", n, double(n) * reps, setBulk);
+    report("union", "set", "contiguous", n, double(2 * n) * reps, setUnite);
+}
+
+// Snapshots of a slowly changing set: a copy followed by one update, for
+// the persistent trie against a deep-copied Set.
+void benchPersistent(size_t n, std::mt19937& rng) {
+    std::vector<int> a = generate("uniform", n, rng), probes = makeProbes(a, rng);
+    PersistentSet trie(a.data(), n);
+    Set set(a.data(), n);
+    Measurement bulk, contains, insert, snapshot, setSnapshot;
+    size_t reps = repetitions(n);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(bulk, [&] { PersistentSet s(a.data(), n); });
+        measure(contains, [&] {
+            size_t hits = 0;
+            for (int p : probes) hits += trie.contains(p);
+            benchSink = hits;
+        });
+        measure(insert, [&] {
+            PersistentSet s;
+            for (int v : a) s += v;
+        });
+        measure(snapshot, [&] {
+            PersistentSet copy = trie;
+            copy += static_cast<int>(r);
+        });
+        measure(setSnapshot, [&] {
+            Set copy = set;
+            copy += static_cast<int>(r);
+        });
+    }
+    report("bulk_build", "persistent_set", "uniform", n, double(n) * reps, bulk);
+    report("contains", "persistent_set", "uniform", n, double(probes.size()) * reps, contains);
+    report("insert", "persistent_set", "uniform", n, double(n) * reps, insert);
+    report("snapshot_update", "persistent_set", "uniform", n, double(reps), snapshot);
+    report("snapshot_update", "set", "uniform", n, double(reps), setSnapshot);
+}
+
+// k-way operators against chains of pairwise + and * over the same sets,
+// which range from n / k to n values. Every set holds the same core of
+// n / 100 values on top of random ones, so intersections never run dry.
+void benchMultiWay(size_t n, size_t k, std::mt19937& rng) {
+    std::uniform_int_distribution<int> any(0, static_cast<int>(2 * n));
+    std::vector<int> core(n / 100);
+    for (int& v : core) v = any(rng);
+    std::vector<Set> sets;
+    for (size_t i = 0; i < k; ++i) {
+        std::vector<int> values(core);
+        values.resize(core.size() + n * (i + 1) / k);
+        for (size_t j = core.size(); j < values.size(); ++j) values[j] = any(rng);
+        sets.push_back(Set(values.data(), values.size()));
+    }
+    std::vector<const Set*> operands;
+    for (const Set& s : sets) operands.push_back(&s);
+    Measurement unionAll, intersectAll, unionChain, intersectChain;
+    size_t reps = repetitions(n);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(unionAll, [&] { Set u = Set::unionAll(operands.data(), k); });
+        measure(intersectAll, [&] { Set i = Set::intersectAll(operands.data(), k); });
+        measure(unionChain, [&] {
+            Set u = sets[0];
+            for (size_t i = 1; i < k; ++i) u = u + sets[i];
+        });
+        measure(intersectChain, [&] {
+            Set i = sets[0];
+            for (size_t j = 1; j < k; ++j) i = i * sets[j];
+        });
+    }
+    std::ostringstream extra;
+    extra << ",\"sets\":" << k;
+    report("union_all", "set", "uniform", n, double(k) * reps, unionAll, extra.str());
+    report("union_all", "pairwise_chain", "uniform", n, double(k) * reps, unionChain, extra.str());
+    report("intersect_all", "set", "uniform", n, double(k) * reps, intersectAll, extra.str());
+    report("intersect_all", "pairwise_chain", "uniform", n, double(k) * reps, intersectChain, extra.str());
+}
+
+// Two sets sharing about a third of their values. The sketch estimate
+// reports its error next to its time.
+void benchSimilarity(size_t n, std::mt19937& rng) {
+    std::vector<int> a = generate("uniform", n, rng), b(a);
+    std::uniform_int_distribution<int> any(0, static_cast<int>(std::min<size_t>(n * 4, INT_MAX / 2)));
+    for (size_t i = 0; i < n; ++i) {
+        if (i % 3) b[i] = any(rng);
+    }
+    Set setA(a.data(), n), setB(b.data(), n);
+    double exact = setA.jaccard(setB);
+    Measurement probed, sketched;
+    size_t reps = repetitions(n);
+    for (size_t r = 0; r < reps; ++r) {
+        measure(probed, [&] { benchSink = setA.unionSize(setB); });
+    }
+    setA.enableSketch();
+    setB.enableSketch();
+    double estimate = 0;
+    measure(sketched, [&] {
+        for (int r = 0; r < 1000; ++r) estimate = setA.approximateJaccard(setB);
+    });
+    std::ostringstream extra;
+    extra << ",\"jaccard\":" << exact << ",\"estimate\":" << estimate << ",\"bins\":" << setA.similaritySketch().bins();
+    report("union_size", "set_probe", "uniform", n, double(n) * reps, probed);
+    report("jaccard_estimate", "set_minhash", "uniform", n, 1000.0, sketched, extra.str());
+}
+
+// Ingests one text file of n values with ingestFile at growing thread
+// counts, against in >> set over an ifstream. Pass a few hundred million as
+// the size argument to get a multi-GB file; it is written next to the
+// other temporary files and removed afterwards.
+void benchIngestScaling(size_t n, std::mt19937& rng) {
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/set_ingest_bench.txt";
+    std::vector<int> values = generate("uniform", std::min<size_t>(n, 1 << 24), rng);
+    {
+        std::ofstream file(path.c_str(), std::ios::binary);
+        for (size_t written = 0; written < n; written += values.size()) {
+            Set slice(values.data(), std::min(values.size(), n - written));
+            file << slice << "\n";
+        }
+    }
+    std::ifstream probe(path.c_str(), std::ios::binary | std::ios::ate);
+    double megabytes = static_cast<double>(probe.tellg()) / 1e6;
+    Measurement sequential;
+    measure(sequential, [&] {
+        std::ifstream in(path.c_str());
+        Set s;
+        in >> s;
+        benchSink = s.size();
+    });
+    std::ostringstream rate;
+    rate << ",\"threads\":1,\"mb_per_s\":" << megabytes / sequential.seconds;
+    report("file_ingest", "stream_extraction", "uniform", n, double(n), sequential, rate.str());
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= std::max(16u, cores); threads *= 2) {
+        Measurement ingest;
+        measure(ingest, [&] {
+            Set s;
+            s.ingestFile(path.c_str(), threads);
+            benchSink = s.size();
+        });
+        std::ostringstream extra;
+        extra << ",\"threads\":" << threads << ",\"mb_per_s\":" << megabytes / ingest.seconds;
+        report("file_ingest", "set", "uniform", n, double(n), ingest, extra.str());
+    }
+    std::remove(path.c_str());
+}
+
+void benchParallelScaling(size_t n, std::mt19937& rng) {
+    std::vector<int> a = generate("uniform", n, rng), b = generate("uniform", n, rng);
+    Set setA(a.data(), n), setB(b.data(), n);
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) counts.push_back(threads);
+    counts.push_back(cores);
+    for (unsigned threads : counts) {
+        Measurement unite, intersect;
+        measure(unite, [&] { Set u = setA.parallelUnion(setB, threads); });
+        measure(intersect, [&] { Set i = setA.parallelIntersection(setB, threads); });
+        std::ostringstream extra;
+        extra << ",\"threads\":" << threads;
+        report("parallel_union", "set", "uniform", n, double(2 * n), unite, extra.str());
+        report("parallel_intersection", "set", "uniform", n, double(2 * n), intersect, extra.str());
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t maxSize = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::mt19937 rng(42);
+    const char* distributions[] = {"uniform", "clustered", "skewed"};
+    for (size_t n = 10; n <= maxSize; n *= 10) {
+        for (const char* distribution : distributions) {
+            std::vector<int> a = generate(distribution, n, rng);
+            std::vector<int> b = generate(distribution, n, rng);
+            std::vector<int> probes = makeProbes(a, rng);
+            benchSet(distribution, a, b, probes);
+            benchBitmap(distribution, a, b, probes);
+            if (n <= 10000) {
+                benchList<LinkedList>("linked_list", distribution, a, b, probes);
+                benchList<UnrolledLinkedList>("unrolled_list", distribution, a, b, probes);
+            }
+        }
+    }
+    benchIntersectKernels(std::min<size_t>(maxSize, 1000000), rng);
+    benchListChurn(rng);
+    benchIntervals(std::min<size_t>(maxSize, 1000000), rng);
+    for (size_t n = 1000; n <= std::min<size_t>(maxSize, 100000); n *= 10) benchPersistent(n, rng);
+    for (size_t k : {10, 50}) benchMultiWay(std::min<size_t>(maxSize, 100000), k, rng);
+    for (size_t n = 10000; n <= std::min<size_t>(maxSize, 1000000); n *= 10) benchSimilarity(n, rng);
+    for (size_t n = 10000; n <= std::min<size_t>(maxSize, 1000000); n *= 10) benchOrdered(n, rng);
+    benchBloomFilter(std::min<size_t>(maxSize, 4000000), rng);
+    for (size_t n = 1000; n <= std::min<size_t>(maxSize, 100000); n *= 10) {
+        if (n <= 10000) benchBackend<SortedListBackend>("basic_set_sorted_list", n, rng);
+        benchBackend<SortedVectorBackend>("basic_set_sorted_vector", n, rng);
+        benchBackend<BasicHashTable>("basic_set_hash", n, rng);
+        benchBackend<WordBitmapBackend>("basic_set_word_bitmap", n, rng);
+        benchBackend<BPlusTreeBackend>("basic_set_bplus_tree", n, rng);
+    }
+    benchParallelScaling(std::min<size_t>(maxSize, 4000000), rng);
+    benchConcurrentScaling(std::min<size_t>(maxSize, 4000000), rng);
+    benchIngestScaling(maxSize, rng);
+    std::cout << (firstRecord ? "[]" : "\n]") << std::endl;
+    return 0;
+}
+#elif defined(SET_TEST)
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+
+// Self-check. Build with -pthread -DSET_TEST, best with
+// -fsanitize=address,undefined as well, and run it without arguments. Every
+// structure, operator and file format above is run on random input from a
+// fixed seed and compared against std::set. Each mismatch is printed, and
+// the exit status is 1 if there was any.
+typedef std::set<int> Reference;
+
+size_t checksRun = 0, checksFailed = 0;
+
+void check(bool ok, const std::string& what) {
+    ++checksRun;
+    if (!ok) {
+        ++checksFailed;
+        std::cerr << "FAILED: " << what << "\n";
+    }
+}
+
+bool matches(std::vector<int> values, const Reference& expected) {
+    std::sort(values.begin(), values.end());
+    return values.size() == expected.size() && std::equal(values.begin(), values.end(), expected.begin());
+}
+
+// What operator<< wrote, read back; every structure here has one.
+template <typename S>
+std::vector<int> printed(const S& s) {
+    std::stringstream text;
+    text << s;
+    std::vector<int> values;
+    int value;
+    while (text >> value) values.push_back(value);
+    return values;
+}
+
+template <typename S>
+std::vector<int> visited(const S& s) {
+    std::vector<int> values;
+    s.forEach([&values](int value) { values.push_back(value); });
+    return values;
+}
+
+template <typename S>
+bool containsAll(const S& s, const Reference& expected, const std::vector<int>& probes) {
+    for (int value : probes) {
+        if (s.contains(value) != (expected.count(value) != 0)) return false;
+    }
+    return true;
+}
+
+Reference unionOf(const Reference& a, const Reference& b) {
+    Reference result(a);
+    result.insert(b.begin(), b.end());
+    return result;
+}
+
+Reference intersectionOf(const Reference& a, const Reference& b) {
+    Reference result;
+    for (int value : a) {
+        if (b.count(value)) result.insert(value);
+    }
+    return result;
+}
+
+// n values of one of four shapes: dense with repeats, sparse over the whole
+// int range, runs of consecutive values, some across a 65536 boundary, and
+// values at both ends of the range.
+const int SHAPES = 4;
+
+std::vector<int> sample(int shape, size_t n, std::mt19937& rng) {
+    std::vector<int> values(n);
+    int spread = static_cast<int>(n) + 4;
+    std::uniform_int_distribution<int> dense(-spread, spread), any(INT_MIN, INT_MAX), start(-(1 << 20), 1 << 20);
+    for (size_t i = 0; i < n;) {
+        if (shape == 0) {
+            values[i++] = dense(rng);
+        } else if (shape == 1) {
+            values[i++] = any(rng);
+        } else if (shape == 2) {
+            int first = start(rng), length = 1 + rng() % 300;
+            for (int k = 0; k < length && i < n; ++k) values[i++] = first + k;
+        } else {
+            int offset = rng() % 100;
+            values[i++] = rng() % 2 ? INT_MIN + offset : INT_MAX - offset;
+        }
+    }
+    return values;
+}
+
+// Every value of the inputs and its neighbours, plus the ends of the range.
+std::vector<int> probesFor(const Reference& a, const Reference& b) {
+    std::vector<int> probes = {INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX};
+    for (const Reference* r : {&a, &b}) {
+        for (int value : *r) {
+            probes.push_back(value);
+            if (value > INT_MIN) probes.push_back(value - 1);
+            if (value < INT_MAX) probes.push_back(value + 1);
+        }
+    }
+    return probes;
+}
+
+std::string tempPath(const char* name) {
+    const char* dir = std::getenv("TMPDIR");
+    return std::string(dir ? dir : "/tmp") + "/" + name;
+}
+
+void checkSet(const std::string& at, const std::vector<int>& va, const std::vector<int>& vb,
+              const std::vector<int>& vc, std::mt19937& rng) {
+    Reference ra(va.begin(), va.end()), rb(vb.begin(), vb.end()), rc(vc.begin(), vc.end());
+    Reference ab = unionOf(ra, rb), aib = intersectionOf(ra, rb);
+    std::vector<int> probes = probesFor(ra, rb);
+    Set a(va.data(), va.size()), b(vb.data(), vb.size()), c(vc.data(), vc.size());
+    check(a.size() == ra.size() && matches(visited(a), ra) && matches(printed(a), ra) && containsAll(a, ra, probes) &&
+              c.size() == rc.size() && matches(visited(c), rc),
+          at + "Set from an array");
+
+    Set u = a + b, i = a * b;
+    check(matches(visited(u), ab) && containsAll(u, ab, probes), at + "a + b");
+    check(matches(visited(i), aib) && containsAll(i, aib, probes), at + "a * b");
+    check(matches(visited(Set(va.data(), va.size()) + b), ab) && matches(visited(a * Set(vb.data(), vb.size())), aib),
+          at + "temporary Set operands");
+    Set grown(a), shrunk(a);
+    grown |= c;
+    shrunk &= c;
+    check(matches(visited(grown), unionOf(ra, rc)) && matches(visited(shrunk), intersectionOf(ra, rc)), at + "|= and &=");
+    Set nested = (a + b) * c, chained = a * b + c;
+    check(matches(visited(nested), intersectionOf(ab, rc)), at + "(a + b) * c");
+    check(matches(visited(chained), unionOf(aib, rc)), at + "a * b + c");
+    auto lazy = Set(vb.data(), vb.size()) + a * c;
+    Set moved = Set(va.data(), va.size()) * (b + c);
+    check(matches(printed(lazy), unionOf(rb, intersectionOf(ra, rc))), at + "expression holding a temporary");
+    check(matches(visited(moved), intersectionOf(ra, unionOf(rb, rc))), at + "temporary * expression");
+    Set big(c);
+    big.enableFilter();
+    size_t fewCount = std::min<size_t>(vb.size(), vb.size() / 64 + 1);
+    Set few(vb.data(), fewCount);
+    Reference rf(vb.begin(), vb.begin() + fewCount);
+    check(matches(visited(few * big), intersectionOf(rf, rc)) && containsAll(big, rc, probes),
+          at + "small * large with a filter");
+
+    Set edited(b);
+    Reference re(rb);
+    edited.enableFilter();
+    edited.enableSketch(64);
+    for (size_t k = 0; k < 2 * va.size() + 20; ++k) {
+        int value = probes[rng() % probes.size()];
+        if (rng() % 3) {
+            edited += value;
+            re.insert(value);
+        } else {
+            edited -= value;
+            re.erase(value);
+        }
+    }
+    check(edited.size() == re.size() && matches(visited(edited), re) && containsAll(edited, re, probes),
+          at + "+= and -=");
+
+    Set filtered(a);
+    filtered.enableFilter(4);
+    std::unique_ptr<bool[]> found(new bool[probes.size()]);
+    std::vector<uint64_t> mask((probes.size() + 63) / 64);
+    for (const Set* s : {&a, &filtered}) {
+        std::fill(mask.begin(), mask.end(), 0);
+        s->containsBatch(probes.data(), probes.size(), found.get());
+        size_t hits = s->containsBatch(probes.data(), probes.size(), mask.data()), expectedHits = 0;
+        bool ok = true;
+        for (size_t k = 0; k < probes.size(); ++k) {
+            bool member = ra.count(probes[k]) != 0;
+            expectedHits += member;
+            ok = ok && found[k] == member && ((mask[k / 64] >> (k % 64) & 1) != 0) == member;
+        }
+        check(ok && hits == expectedHits, at + (s == &a ? "containsBatch" : "containsBatch with a filter"));
+    }
+
+    check(a.intersectionSize(b) == aib.size() && a.unionSize(b) == ab.size(), at + "intersectionSize and unionSize");
+    check(a.jaccard(b) == (ab.empty() ? 1.0 : double(aib.size()) / ab.size()), at + "jaccard");
+    Set sa(a), sb(b);
+    sa.enableSketch();
+    sb.enableSketch();
+    double estimate = sa.approximateJaccard(sb);
+    check(estimate >= 0 && estimate <= 1 && sa.approximateJaccard(sa) == 1.0, at + "approximateJaccard");
+    if (!va.empty()) {
+        sa -= va[0];
+        Set fresh(sa);
+        fresh.enableSketch();
+        check(sa.approximateJaccard(sb) == fresh.approximateJaccard(sb), at + "approximateJaccard after a removal");
+    }
+
+    const Set* all[] = {&a, &b, &c};
+    check(matches(visited(Set::unionAll(all, 3)), unionOf(ab, rc)) &&
+              matches(visited(Set::intersectAll(all, 3)), intersectionOf(aib, rc)),
+          at + "unionAll and intersectAll");
+    check(matches(visited(a.parallelUnion(b, 3)), ab) && matches(visited(a.parallelIntersection(b, 3)), aib),
+          at + "parallelUnion and parallelIntersection");
+
+    std::stringstream text;
+    text << a;
+    Set read(b);
+    text >> read;
+    check(matches(visited(read), ab) && text.eof(), at + "operator<< and operator>>");
+    Set positive;
+    Reference rp;
+    for (int value : rc) {
+        if (value >= 0) {
+            positive += value;
+            rp.insert(value);
+        }
+    }
+    std::stringstream hex;
+    hex << std::hex << positive;
+    Set readHex;
+    hex >> std::hex >> readHex;
+    check(matches(visited(readHex), rp), at + "operator>> in hex");
+
+    std::ostringstream deltas;
+    check(a.writeDeltas(deltas), at + "writeDeltas");
+    std::string bytes = deltas.str();
+    std::istringstream whole(bytes), truncated(bytes.substr(0, bytes.size() - 1));
+    Set fromDeltas(b), untouched(b);
+    check(fromDeltas.readDeltas(whole) && matches(visited(fromDeltas), ra), at + "readDeltas");
+    check(!untouched.readDeltas(truncated) && truncated.fail() && matches(visited(untouched), rb),
+          at + "readDeltas on a truncated stream");
+
+    std::string path = tempPath("set_test.bin");
+    Set loaded(c);
+    check(a.save(path.c_str()) && loaded.load(path.c_str(), true) && matches(visited(loaded), ra), at + "save and load");
+    MappedSet file;
+    check(file.open(path.c_str(), true) && file.size() == ra.size() && matches(printed(file), ra) &&
+              containsAll(file, ra, probes),
+          at + "MappedSet");
+    check(file.intersectionSize(b) == aib.size() && matches(visited(file.intersection(b)), aib) &&
+              matches(visited(file.toSet()), ra),
+          at + "MappedSet against a Set");
+    file.close();
+    std::remove(path.c_str());
+
+    std::string textPath = tempPath("set_test.txt");
+    {
+        std::ofstream out(textPath.c_str());
+        out << "  " << a << "\n" << c << "\n";
+    }
+    Set ingested(b), threaded(b);
+    Reference everything = unionOf(ab, rc);
+    check(ingested.ingestFile(textPath.c_str(), 1) && matches(visited(ingested), everything) &&
+              threaded.ingestFile(textPath.c_str(), 4) && matches(visited(threaded), everything),
+          at + "ingestFile");
+    {
+        std::ofstream out(textPath.c_str(), std::ios::app);
+        out << " 12x";
+    }
+    Set rejected(b);
+    check(!rejected.ingestFile(textPath.c_str(), 4) && matches(visited(rejected), rb), at + "ingestFile on bad input");
+    std::remove(textPath.c_str());
+}
+
+// Inputs past PARALLEL_THRESHOLD, where the bulk build sorts and fills the
+// table in parallel on a machine with more than one core.
+void checkBulkBuild(std::mt19937& rng) {
+    for (int shape : {0, 1}) {
+        std::vector<int> values = sample(shape, PARALLEL_THRESHOLD + 1000, rng);
+        Reference expected(values.begin(), values.end());
+        Set s(values.data(), values.size());
+        check(s.size() == expected.size() && matches(visited(s), expected) && containsAll(s, expected, values),
+              "bulk build past PARALLEL_THRESHOLD, shape " + std::to_string(shape));
+    }
+}
+
+// A set grown one value at a time past the inline capacity and shrunk back,
+// copied, moved and assigned at every size, so both storages and the
+// switch between them are covered. INT_MIN is the table's empty key.
+void checkInline() {
+    Set grown;
+    Reference expected;
+    bool ok = true;
+    for (int k = 0; k < SET_INLINE_CAPACITY * 3; ++k) {
+        int value = k == 0 ? INT_MIN : k * 7 - 20;
+        grown += value;
+        expected.insert(value);
+        Set copy(grown), moved(std::move(copy)), assigned;
+        assigned = moved;
+        ok = ok && matches(visited(grown), expected) && matches(visited(moved), expected) &&
+             matches(visited(assigned), expected) && grown.contains(value) && !grown.contains(value + 1);
+    }
+    for (int value : Reference(expected)) {
+        grown -= value;
+        expected.erase(value);
+        ok = ok && matches(visited(grown), expected) && !grown.contains(value);
+    }
+    check(ok, "Set across the inline capacity");
+}
+
+void checkBitmap(const std::string& at, const std::vector<int>& va, const std::vector<int>& vb,
+                 const std::vector<int>& vc) {
+    Reference ra(va.begin(), va.end()), rb(vb.begin(), vb.end()), rc(vc.begin(), vc.end());
+    std::vector<int> probes = probesFor(ra, rc);
+    CompressedBitmap a(va.data(), va.size()), b(vb.data(), vb.size()), grown;
+    for (int value : vc) grown += value;
+    check(a.size() == ra.size() && matches(printed(a), ra) && containsAll(a, ra, probes), at + "CompressedBitmap");
+    check(grown.size() == rc.size() && matches(printed(grown), rc) && containsAll(grown, rc, probes),
+          at + "CompressedBitmap +=");
+    check(matches(printed(a + b), unionOf(ra, rb)) && matches(printed(a * b), intersectionOf(ra, rb)) &&
+              matches(printed(a * grown), intersectionOf(ra, rc)),
+          at + "CompressedBitmap + and *");
+}
+
+// Runs of 50 every 1000 values, which the array constructor stores as RUN
+// containers. The values added then extend runs on either side, start runs
+// of their own, and fill the gaps between runs in random order, so
+// neighbours join and the chunks pass through so many runs that they turn
+// into bitsets.
+void checkBitmapRuns(std::mt19937& rng) {
+    std::vector<int> values, added;
+    for (int start = -200000; start < 200000; start += 1000) {
+        for (int k = 0; k < 50; ++k) values.push_back(start + k);
+    }
+    for (int start = -200000, r = 0; start < 200000; start += 1000, ++r) {
+        if (r % 4 == 0) added.push_back(start - 1);
+        if (r % 4 == 1) added.push_back(start + 50);
+        if (r % 4 == 2) {
+            for (int k = 50; k < 1000; ++k) added.push_back(start + k);
+        }
+        if (r % 4 == 3) added.push_back(start + 500);
+    }
+    std::shuffle(added.begin(), added.end(), rng);
+    CompressedBitmap bitmap(values.data(), values.size());
+    Reference expected(values.begin(), values.end());
+    std::vector<int> probes;
+    for (int value = -201000; value < 201000; ++value) probes.push_back(value);
+    bool ok = true;
+    for (size_t k = 0; k < added.size(); ++k) {
+        bitmap += added[k];
+        expected.insert(added[k]);
+        if (k % 20000 == 0 || k + 1 == added.size()) {
+            ok = ok && bitmap.size() == expected.size() && matches(printed(bitmap), expected) &&
+                 containsAll(bitmap, expected, probes);
+        }
+    }
+    check(ok, "CompressedBitmap += on RUN containers");
+}
+
+void checkIntervals(const std::string& at, const std::vector<int>& va, const std::vector<int>& vb,
+                    std::mt19937& rng) {
+    Reference ra(va.begin(), va.end()), rb(vb.begin(), vb.end());
+    std::vector<int> probes = probesFor(ra, rb);
+    IntervalSet a(va.data(), va.size()), b(vb.data(), vb.size());
+    check(a.size() == ra.size() && matches(visited(a), ra) && containsAll(a, ra, probes), at + "IntervalSet");
+    check(matches(visited(a + b), unionOf(ra, rb)) && matches(visited(a * b), intersectionOf(ra, rb)),
+          at + "IntervalSet + and *");
+    for (size_t k = 0; k < std::min<size_t>(va.size(), 2000) + 20; ++k) {
+        int value = probes[rng() % probes.size()];
+        if (rng() % 3 == 0) {
+            a -= value;
+            ra.erase(value);
+        } else {
+            int hi = value > INT_MAX - 20 ? INT_MAX : value + static_cast<int>(rng() % 20);
+            a.addRange(value, hi);
+            for (int64_t v = value; v <= hi; ++v) ra.insert(static_cast<int>(v));
+        }
+    }
+    size_t runs = 0;
+    for (int value : ra) runs += value == INT_MIN || !ra.count(value - 1);
+    check(a.size() == ra.size() && a.spanCount() == runs && matches(visited(a), ra) && containsAll(a, ra, probes),
+          at + "IntervalSet addRange and -=");
+}
+
+void checkPersistent(const std::string& at, const std::vector<int>& va, std::mt19937& rng) {
+    Reference ra(va.begin(), va.end());
+    std::vector<int> probes = probesFor(ra, ra);
+    PersistentSet current(va.data(), va.size());
+    check(current.size() == ra.size() && matches(visited(current), ra) && containsAll(current, ra, probes),
+          at + "PersistentSet");
+    std::vector<std::pair<PersistentSet, Reference>> versions;
+    for (size_t k = 0; k < std::min<size_t>(va.size(), 2000) + 20; ++k) {
+        int value = probes[rng() % probes.size()];
+        if (k % 50 == 0) versions.push_back(std::make_pair(current, ra));
+        if (rng() % 3) {
+            current = current.with(value);
+            ra.insert(value);
+        } else if (rng() % 2) {
+            current = current.without(value);
+            ra.erase(value);
+        } else {
+            current -= value;
+            ra.erase(value);
+        }
+    }
+    bool ok = current.size() == ra.size() && matches(visited(current), ra) && containsAll(current, ra, probes);
+    for (const auto& version : versions) {
+        ok = ok && version.first.size() == version.second.size() && matches(visited(version.first), version.second);
+    }
+    check(ok, at + "PersistentSet snapshots");
+}
+
+template <template <typename> class Backend>
+void checkBackend(const std::string& at, const std::vector<int>& va, const std::vector<int>& vb, std::mt19937& rng) {
+    Reference ra(va.begin(), va.end()), rb(vb.begin(), vb.end());
+    std::vector<int> probes = probesFor(ra, rb);
+    BasicSet<int, Backend> a(va.data(), va.size()), b(vb.data(), vb.size());
+    check(a.size() == ra.size() && matches(visited(a), ra) && matches(printed(a), ra) && containsAll(a, ra, probes),
+          at + "BasicSet");
+    check(matches(visited(a + b), unionOf(ra, rb)) && matches(visited(a * b), intersectionOf(ra, rb)),
+          at + "BasicSet + and *");
+    for (size_t k = 0; k < std::min<size_t>(va.size(), 2000) + 20; ++k) {
+        int value = probes[rng() % probes.size()];
+        if (rng() % 3) {
+            b += value;
+            rb.insert(value);
+        } else {
+            b -= value;
+            rb.erase(value);
+        }
+    }
+    check(b.size() == rb.size() && matches(visited(b), rb) && containsAll(b, rb, probes), at + "BasicSet += and -=");
+}
+
+// Enough values for several inner levels, then removals down to a few so
+// nodes merge, with the ordered queries checked at both points.
+void checkOrdered(std::mt19937& rng) {
+    BasicSet<int, BPlusTreeBackend> tree;
+    Reference expected;
+    std::uniform_int_distribution<int> pick(-40000, 40000);
+    auto verify = [&](const std::string& what) {
+        bool ok = tree.size() == expected.size() && matches(visited(tree), expected);
+        std::vector<int> ordered = visited(tree);
+        ok = ok && std::is_sorted(ordered.begin(), ordered.end());
+        for (int k = 0; k < 2000 && ok; ++k) {
+            int lo = pick(rng), hi = pick(rng);
+            size_t below = std::distance(expected.begin(), expected.lower_bound(lo));
+            size_t inRange = lo > hi ? 0 : std::distance(expected.lower_bound(lo), expected.upper_bound(hi));
+            std::vector<int> range;
+            tree.rangeIterate(lo, hi, [&range](int value) { range.push_back(value); });
+            ok = tree.rank(lo) == below && tree.countInRange(lo, hi) == inRange && range.size() == inRange &&
+                 std::equal(range.begin(), range.end(), expected.lower_bound(lo));
+        }
+        size_t k = 0;
+        for (int value : expected) {
+            int selected = 0;
+            if (k % 7 == 0) ok = ok && tree.select(k, selected) && selected == value;
+            ++k;
+        }
+        int unused;
+        check(ok && !tree.select(expected.size(), unused), "BPlusTreeBackend " + what);
+    };
+    for (int value = -5000; value < 5000; ++value) {
+        tree += value;
+        expected.insert(value);
+    }
+    for (int k = 0; k < 40000; ++k) {
+        int value = pick(rng);
+        tree += value;
+        expected.insert(value);
+    }
+    verify("after inserts");
+    for (int k = 0; k < 200000 && expected.size() > 50; ++k) {
+        int value = pick(rng);
+        tree -= value;
+        expected.erase(value);
+    }
+    verify("after removals");
+}
+
+template <typename List>
+void checkList(const std::string& name, std::mt19937& rng) {
+    List list;
+    Reference expected;
+    std::uniform_int_distribution<int> pick(-150, 150);
+    std::vector<int> probes;
+    for (int value = -152; value <= 152; ++value) probes.push_back(value);
+    bool ok = true;
+    for (int step = 0; step < 4000; ++step) {
+        int value = pick(rng);
+        if (rng() % 3) {
+            list.insert(value);
+            expected.insert(value);
+        } else {
+            list.remove(value);
+            expected.erase(value);
+        }
+        if (step % 500 == 499) ok = ok && containsAll(list, expected, probes) && matches(printed(list), expected);
+    }
+    check(ok, name + " insert and remove");
+    List copy(list), assigned;
+    assigned = list;
+    List moved(std::move(copy));
+    list.insert(1000);
+    check(matches(printed(assigned), expected) && matches(printed(moved), expected), name + " copy and move");
+}
+
+void checkSharedPool(std::mt19937& rng) {
+    LinkedList::NodePool pool;
+    LinkedList a(pool), b(pool);
+    Reference ra, rb;
+    std::uniform_int_distribution<int> pick(0, 300);
+    for (int step = 0; step < 3000; ++step) {
+        LinkedList& list = step % 2 ? a : b;
+        Reference& expected = step % 2 ? ra : rb;
+        int value = pick(rng);
+        if (rng() % 3) {
+            list.insert(value);
+            expected.insert(value);
+        } else {
+            list.remove(value);
+            expected.erase(value);
+        }
+    }
+    check(matches(printed(a), ra) && matches(printed(b), rb), "LinkedList on a shared NodePool");
+}
+
+// Files with a valid header and checksum over a payload that is not
+// strictly ascending: repeats, descending values, and a shuffle with
+// repeats. They must load as the set of their values, and intersections
+// with them must stay within the true ones without writing out of bounds.
+void checkMalformedFile(std::mt19937& rng) {
+    std::vector<std::vector<int>> payloads(3);
+    payloads[0].assign(64, 5);
+    for (int value = 300; value > 0; --value) payloads[1].push_back(value);
+    for (int k = 0; k < 1000; ++k) payloads[2].push_back(static_cast<int>(rng() % 200));
+    std::vector<int> few = {5, 6, 7, 8}, many;
+    for (int value = 0; value < 256; ++value) many.push_back(value);
+    std::string path = tempPath("set_test_malformed.bin");
+    for (size_t k = 0; k < payloads.size(); ++k) {
+        const std::vector<int>& values = payloads[k];
+        SetFileHeader header = {};
+        std::memcpy(header.magic, SET_FILE_MAGIC, 4);
+        header.version = SET_FILE_VERSION;
+        header.valueWidth = sizeof(int);
+        header.flags = SET_FILE_HAS_CHECKSUM;
+        header.count = values.size();
+        header.checksum =
+            payloadChecksum(reinterpret_cast<const unsigned char*>(values.data()), values.size() * sizeof(int));
+        {
+            std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int));
+        }
+        Reference distinct(values.begin(), values.end());
+        MappedSet file;
+        Set loaded;
+        bool ok = file.open(path.c_str(), true) && loaded.load(path.c_str(), true) &&
+                  matches(visited(loaded), distinct) && matches(visited(file.toSet()), distinct);
+        for (const std::vector<int>* other : {&few, &many}) {
+            Set s(other->data(), other->size());
+            Reference expected = intersectionOf(distinct, Reference(other->begin(), other->end()));
+            std::vector<int> found = visited(file.intersection(s));
+            Reference unique(found.begin(), found.end());
+            ok = ok && unique.size() == found.size() &&
+                 std::includes(expected.begin(), expected.end(), unique.begin(), unique.end());
+            file.intersectionSize(s);
+        }
+        std::ostringstream label;
+        label << "MappedSet on malformed payload " << k;
+        check(ok, label.str());
+    }
+    std::remove(path.c_str());
+}
+
+// Every kernel on sorted arrays of many length pairs, short ones around the
+// block widths and lopsided ones that gallop, placed so some straddle zero
+// or sit at an end of the int range.
+void checkKernels(std::mt19937& rng) {
+    typedef size_t (*Kernel)(const int*, size_t, const int*, size_t, int*);
+    std::vector<std::pair<std::string, Kernel>> kernels;
+    kernels.push_back(std::make_pair("intersectScalar", intersectScalar));
+    kernels.push_back(std::make_pair("intersectSorted", static_cast<Kernel>(intersectSorted)));
+#ifdef SET_X86_SIMD
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+        kernels.push_back(std::make_pair("intersectSse", intersectSse));
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        kernels.push_back(std::make_pair("intersectAvx2", intersectAvx2));
+    }
+#endif
+    const size_t lengths[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 33, 100, 1000, 20000};
+    std::vector<bool> ok(kernels.size() + 2, true);
+    for (size_t na : lengths) {
+        for (size_t nb : lengths) {
+            for (int placement = 0; placement < 3; ++placement) {
+                int range = static_cast<int>((na + nb) * (1 + rng() % 4) + 1);
+                int base = placement == 0 ? -range / 2 : placement == 1 ? INT_MIN : INT_MAX - range;
+                std::vector<int> a, b;
+                for (std::vector<int>* v : {&a, &b}) {
+                    Reference chosen;
+                    size_t n = v == &a ? na : nb;
+                    while (chosen.size() < n) chosen.insert(base + static_cast<int>(rng() % range));
+                    v->assign(chosen.begin(), chosen.end());
+                }
+                std::vector<int> common, all;
+                std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(common));
+                std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(all));
+                std::vector<int> out(std::min(na, nb) + 8);
+                for (size_t k = 0; k < kernels.size(); ++k) {
+                    size_t n = kernels[k].second(a.data(), na, b.data(), nb, out.data());
+                    ok[k] = ok[k] && n == common.size() && std::equal(common.begin(), common.end(), out.begin()) &&
+                            kernels[k].second(a.data(), na, b.data(), nb, nullptr) == common.size();
+                }
+                const std::vector<int>& small = na <= nb ? a : b;
+                const std::vector<int>& large = na <= nb ? b : a;
+                size_t n = intersectGallop(small.data(), small.size(), large.data(), large.size(), out.data());
+                ok[kernels.size()] = ok[kernels.size()] && n == common.size() &&
+                                     std::equal(common.begin(), common.end(), out.begin());
+                out.resize(na + nb + 8);
+                n = mergeUnion(a.data(), na, b.data(), nb, out.data());
+                ok[kernels.size() + 1] = ok[kernels.size() + 1] && n == all.size() &&
+                                         std::equal(all.begin(), all.end(), out.begin());
+            }
+        }
+    }
+    for (size_t k = 0; k < kernels.size(); ++k) check(ok[k], kernels[k].first);
+    check(ok[kernels.size()], "intersectGallop");
+    check(ok[kernels.size() + 1], "mergeUnion");
+}
+
+// operator>> on texts with every kind of spacing and bad token, in the
+// other bases, and on a text long enough for several input batches.
+void checkParser(std::mt19937& rng) {
+    struct Case {
+        const char* text;
+        std::vector<int> values;
+        bool complete;
+    };
+    const Case cases[] = {
+        {"", {}, true},
+        {" 1 -2\t+3\n\n4 ", {1, -2, 3, 4}, true},
+        {"-2147483648 2147483647", {INT_MIN, INT_MAX}, true},
+        {"007 -0", {7, 0}, true},
+        {"1 2147483648 3", {1}, false},
+        {"5 -2147483649 6", {5}, false},
+        {"7 x 8", {7}, false},
+        {"9 --1", {9}, false},
+    };
+    for (const Case& c : cases) {
+        Reference expected(c.values.begin(), c.values.end());
+        std::istringstream in(c.text);
+        Set s;
+        in >> s;
+        check(matches(visited(s), expected) && in.fail() && in.eof() == c.complete,
+              std::string("operator>> on \"") + c.text + "\"");
+        std::vector<int> parsed;
+        bool complete = parseInts(c.text, c.text + std::strlen(c.text), parsed);
+        check(complete == c.complete && matches(parsed, expected), std::string("parseInts on \"") + c.text + "\"");
+    }
+    std::istringstream hex("10 ff 20"), oct("10 17"), any("0x10 010 9");
+    Set h, o, a;
+    hex >> std::hex >> h;
+    oct >> std::oct >> o;
+    any.unsetf(std::ios_base::basefield);
+    any >> a;
+    check(matches(visited(h), Reference{16, 255, 32}) && matches(visited(o), Reference{8, 15}) &&
+              matches(visited(a), Reference{16, 8, 9}),
+          "operator>> in other bases");
+
+    std::vector<int> values = sample(1, 400000, rng);
+    Reference expected(values.begin(), values.end());
+    Set source(values.data(), values.size());
+    std::string path = tempPath("set_test_large.txt");
+    {
+        std::ofstream out(path.c_str());
+        out << source;
+    }
+    std::ifstream in(path.c_str());
+    Set streamed;
+    in >> streamed;
+    check(matches(visited(streamed), expected), "operator>> on a large file");
+    Set ingested;
+    check(ingested.ingestFile(path.c_str(), 4) && matches(visited(ingested), expected), "ingestFile on a large file");
+    std::remove(path.c_str());
+}
+
+// Threads insert overlapping slices, INT_MIN among them, into a table
+// sized too small so it grows while they run.
+void checkConcurrent(std::mt19937& rng) {
+    std::vector<int> values = sample(0, 200000, rng);
+    values.push_back(INT_MIN);
+    values.push_back(INT_MIN);
+    Reference expected(values.begin(), values.end());
+    ConcurrentSet set;
+    std::atomic<size_t> added(0);
+    std::vector<std::thread> workers;
+    const size_t threads = 4;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            size_t first = values.size() * t / threads, last = values.size() * (t + 1) / threads;
+            for (size_t i = first; i < last; ++i) added += set.insert(values[i]);
+            for (size_t i = 0; i < values.size(); i += 97) set.contains(values[i]);
+        });
+    }
+    for (std::thread& t : workers) t.join();
+    check(added == expected.size() && set.size() == expected.size() && containsAll(set, expected, values),
+          "ConcurrentSet insert");
+    Set frozen = set.freeze();
+    check(matches(visited(frozen), expected) && set.size() == 0, "ConcurrentSet freeze");
+}
+
+int main() {
+    std::mt19937 rng(7);
+    const size_t sizes[] = {0, 1, 7, 16, 17, 200, 3000, 70000};
+    for (size_t n : sizes) {
+        for (int shape = 0; shape < SHAPES; ++shape) {
+            std::ostringstream label;
+            label << "shape " << shape << ", n " << n << ": ";
+            std::vector<int> a = sample(shape, n, rng), b = sample(shape, n / 2 + 1, rng), c = sample(shape, n, rng);
+            checkSet(label.str(), a, b, c, rng);
+            checkBitmap(label.str(), a, b, c);
+            checkIntervals(label.str(), a, b, rng);
+            checkPersistent(label.str(), a, rng);
+            if (n <= 3000) checkBackend<SortedListBackend>(label.str() + "SortedListBackend ", a, b, rng);
+            checkBackend<SortedVectorBackend>(label.str() + "SortedVectorBackend ", a, b, rng);
+            checkBackend<BasicHashTable>(label.str() + "BasicHashTable ", a, b, rng);
+            checkBackend<WordBitmapBackend>(label.str() + "WordBitmapBackend ", a, b, rng);
+            checkBackend<BPlusTreeBackend>(label.str() + "BPlusTreeBackend ", a, b, rng);
+        }
+    }
+    checkBitmapRuns(rng);
+    checkBulkBuild(rng);
+    checkInline();
+    checkOrdered(rng);
+    checkList<LinkedList>("LinkedList", rng);
+    checkSharedPool(rng);
+    checkList<UnrolledLinkedList>("UnrolledLinkedList", rng);
+    checkMalformedFile(rng);
+    checkKernels(rng);
+    checkParser(rng);
+    checkConcurrent(rng);
+    std::cout << checksRun << " checks, " << checksFailed << " failed" << std::endl;
+    return checksFailed ? 1 : 0;
+}
+#endif